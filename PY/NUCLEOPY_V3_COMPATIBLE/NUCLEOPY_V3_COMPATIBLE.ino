@@ -9,17 +9,30 @@
  * GND -> GND
  * 
  * Protocolo STM32 -> NodeMCU:
- * - UID:AABBCCDD        (tarjeta detectada)
+ * - UID:AABBCCDD[...]   (tarjeta detectada, UID de 4, 7 o 10 bytes)
  * - DATA:AABBCCDD...    (16 bytes de datos del bloque)
  * - WRITE:OK / WRITE:FAIL
  * - READ:OK / READ:FAIL
  * - AUTH:FAIL
- * - CARD:REMOVED
+ * - CARD:REMOVED:AABBCCDD (tarjeta retirada del lector)
+ * - ACCESS:GRANTED / ACCESS:DENIED / ACCESS:REVOKED (decisión local del
+ *   STM32: lista blanca y filtro de revocadas)
+ * 
+ * - SYNC:ACK:<seq> / SYNC:NAK:<seq>:<motivo> / SYNC:DIGEST:<ver>:<n>:<crc>
+ *   (sincronización de la lista blanca, ver sync.h del STM32)
+ * - LOG:<seq>:<arranque>:<ms>:<uid>:<resultado>:<hash> (diario de accesos
+ *   del STM32; se reenvía hasta recibir el ACK, ver journal.h)
+ * - LOG:SKIP:<seq> / LOG:ACKED:<seq> (hueco en el diario / último ACK)
+ * - LOG:Q:<seq>:... / LOG:QEND:<n> (resultado de una consulta del diario)
  * 
  * Protocolo NodeMCU -> STM32:
  * - CMD_WRITE:AABBCCDD:LEVEL:NAME (comando para escribir en tarjeta)
  * - W + 16 bytes (datos a escribir)
  * - R (comando para leer)
+ * - SYNC:DIGEST, SYNC:BEGIN/ADD/DEL/COMMIT (delta de la lista blanca)
+ * - LOG:ACK:<seq> (registros del diario recibidos en orden hasta seq)
+ * - LOG:STATUS (pide el último ACK al arrancar)
+ * - LOG:QUERY:<uid>[:<desde seq>] (consulta del diario por tarjeta)
  */
 
 #include <ESP8266WiFi.h>
@@ -43,6 +56,12 @@ String lastAccessLevel = "";
 String lastAccessName = "";
 String lastBlockData = "";
 unsigned long lastCardTime = 0;
+unsigned long lastLogSeq = 0;     // Último registro del diario recibido en orden
+bool logSynced = false;           // lastLogSeq viene del STM32 (LOG:ACKED)
+
+// Última consulta del diario (/journal)
+String journalResult = "";
+bool journalDone = true;
 
 // Estado de operación
 enum OperationState {
@@ -73,6 +92,7 @@ void setup() {
     Serial.println("=================================");
     
     stm32Serial.begin(9600);
+    stm32Serial.print("LOG:STATUS\n");  // Punto de partida del diario
     
     // Conectar a WiFi
     WiFi.begin(ssid, password);
@@ -101,6 +121,7 @@ void setup() {
     server.on("/status", handleStatus);
     server.on("/history", handleHistory);
     server.on("/write", handleWrite);
+    server.on("/journal", handleJournal);
     
     server.begin();
     Serial.println("✓ Servidor web iniciado");
@@ -136,8 +157,23 @@ void loop() {
             else if (data.startsWith("AUTH:")) {
                 handleAuthResult(data);
             }
+            else if (data.startsWith("ACCESS:")) {
+                handleAccessResult(data);
+            }
+            else if (data.startsWith("SYNC:")) {
+                Serial.println("→ Sincronización: " + data.substring(5));
+            }
+            else if (data.startsWith("LOG:ACKED:") || data.startsWith("LOG:SKIP:")) {
+                handleLogSync(data);
+            }
+            else if (data.startsWith("LOG:Q")) {
+                handleJournalQuery(data);
+            }
+            else if (data.startsWith("LOG:")) {
+                handleLogRecord(data);
+            }
             else if (data.startsWith("CARD:REMOVED")) {
-                handleCardRemoved();
+                handleCardRemoved(data);
             }
             else {
                 Serial.println("→ Mensaje no reconocido: " + data);
@@ -149,8 +185,8 @@ void loop() {
 // ========== Manejadores del STM32 ==========
 
 void handleUID(String data) {
-    // Format: UID:AABBCCDD
-    lastCardId = data.substring(4);  // Extraer AABBCCDD
+    // Format: UID:AABBCCDD (8, 14 o 20 caracteres hex)
+    lastCardId = data.substring(4);  // Extraer el UID completo
     lastCardTime = millis();
     lastAccessStatus = "";
     lastBlockData = "";
@@ -200,7 +236,77 @@ void handleAuthResult(String data) {
     currentState = STATE_IDLE;
 }
 
-void handleCardRemoved() {
+void handleAccessResult(String data) {
+    // Format: ACCESS:GRANTED, ACCESS:DENIED o ACCESS:REVOKED (la puerta ya
+    // la movió el STM32)
+    String result = data.substring(7);
+    Serial.println("→ Acceso " + result);
+    addToHistory(lastCardId, result, "", "");
+}
+
+void handleLogSync(String data) {
+    // Format: LOG:ACKED:<seq> (punto de partida) o LOG:SKIP:<seq> (registros
+    // perdidos en el STM32 hasta seq)
+    if (data.startsWith("LOG:ACKED:")) {
+        lastLogSeq = data.substring(10).toInt();
+        logSynced = true;
+        Serial.println("→ Diario: continuar tras " + String(lastLogSeq));
+        return;
+    }
+    if (!logSynced) return;
+    
+    unsigned long seq = data.substring(9).toInt();
+    if (seq > lastLogSeq) {
+        Serial.println("→ Diario: perdidos " + String(lastLogSeq + 1) + "-" + String(seq));
+        lastLogSeq = seq;
+    }
+    stm32Serial.print("LOG:ACK:" + String(lastLogSeq) + "\n");
+}
+
+void handleLogRecord(String data) {
+    // Format: LOG:<seq>:<arranque>:<ms>:<uid>:<resultado>:<hash>
+    int sep = data.indexOf(':', 4);
+    if (sep < 0) return;
+    unsigned long seq = data.substring(4, sep).toInt();
+    
+    // Sin punto de partida no se confirma nada (el STM32 reenviará)
+    if (!logSynced) {
+        stm32Serial.print("LOG:STATUS\n");
+        return;
+    }
+    
+    // Solo en orden: ante un hueco (línea corrompida) se repite el último
+    // ACK y el STM32 vuelve a enviar desde ahí. Los repetidos tras un
+    // corte se descartan
+    if (seq == lastLogSeq + 1) {
+        Serial.println("→ Diario: " + data.substring(4));
+        lastLogSeq = seq;
+    }
+    stm32Serial.print("LOG:ACK:" + String(lastLogSeq) + "\n");
+}
+
+void handleJournalQuery(String data) {
+    // Format: LOG:Q:<seq>:<arranque>:<ms>:<uid>:<resultado>:<hash>
+    //         LOG:QEND:<n>[:ABORT|:ERROR]
+    if (data.startsWith("LOG:QEND:")) {
+        Serial.println("→ Consulta del diario: " + data.substring(9));
+        journalDone = true;
+        return;
+    }
+    if (journalResult.length() < 4096) {
+        if (journalResult.length() > 0) journalResult += ",";
+        journalResult += "\"" + data.substring(6) + "\"";
+    }
+}
+
+void handleCardRemoved(String data) {
+    // Format: CARD:REMOVED:AABBCCDD (el UID puede faltar)
+    String uid = data.length() > 13 ? data.substring(13) : "";
+    if (uid.length() > 0 && uid != lastCardId) {
+        Serial.println("→ Tarjeta removida: " + uid);
+        return;  // Otra tarjeta del lote, la actual sigue presente
+    }
+    
     Serial.println("→ Tarjeta removida");
     lastCardId = "";
     lastAccessStatus = "";
@@ -617,6 +723,29 @@ void handleHistory() {
     server.send(200, "application/json", json);
 }
 
+void handleJournal() {
+    // /journal?uid=AABBCCDD[&since=<seq>] lanza la consulta; /journal
+    // devuelve lo recibido hasta ahora
+    if (server.hasArg("uid")) {
+        String uid = server.arg("uid");
+        uid.toUpperCase();
+        String cmd = "LOG:QUERY:" + uid;
+        if (server.hasArg("since")) cmd += ":" + server.arg("since");
+        
+        journalResult = "";
+        journalDone = false;
+        stm32Serial.print(cmd + "\n");
+        Serial.println("→ STM32: " + cmd);
+        server.send(200, "text/plain", "✓ Consulta enviada");
+        return;
+    }
+    
+    String json = "{\"done\":";
+    json += journalDone ? "true" : "false";
+    json += ",\"records\":[" + journalResult + "]}";
+    server.send(200, "application/json", json);
+}
+
 void handleWrite() {
     if (server.hasArg("cardId") && server.hasArg("level")) {
         String cardId = server.arg("cardId");
@@ -0,0 +1,368 @@
+#include <string.h>
+#include "access.h"
+#include "keys.h"
+#include "mifare.h"
+#include "rc522.h"
+
+#define A   ACCESS_KEY_A
+#define B   ACCESS_KEY_B
+#define AB  ACCESS_KEY_ANY
+
+// Permisos por condición C1C2C3 (índice C1<<2 | C2<<1 | C3), MF1S50 tablas 7 y 8
+static const uint8_t data_read[8]     = { AB, AB, AB, B,  AB, B,  AB, 0 };
+static const uint8_t data_write[8]    = { AB, 0,  0,  B,  B,  0,  B,  0 };
+static const uint8_t trailer_read[8]  = { A,  A,  A,  AB, AB, AB, AB, AB };
+// Escritura del trailer completo: solo si los bits de acceso son escribibles
+static const uint8_t trailer_write[8] = { 0,  A,  0,  B,  0,  B,  0,  0 };
+
+#undef A
+#undef B
+#undef AB
+
+// Condiciones 000, 010 y 001 del trailer: la clave B es legible y no
+// sirve para autenticar
+#define KEYB_READABLE(c)    ((c) == 0 || (c) == 2 || (c) == 1)
+
+#define SECTOR_KNOWN        0x8000  // Bits 0-11: condición de los 4 grupos
+
+static uint16_t sector_access[MIFARE_4K_SECTORS];
+static Access_Stats stats;
+
+// Bloque -> grupo de condiciones (0-2 datos, 3 trailer)
+static uint8_t block_group(uint8_t blockAddr) {
+    uint8_t sector = MIFARE_BlockSector(blockAddr);
+    uint8_t offset = blockAddr - MIFARE_SectorFirstBlock(sector);
+    if(MIFARE_SectorBlockCount(sector) == 4) {
+        return offset;
+    }
+    return (offset == 15) ? 3 : (uint8_t)(offset / 5);
+}
+
+void Access_Reset(void) {
+    memset(sector_access, 0, sizeof(sector_access));
+}
+
+int Access_Learn(uint8_t trailerBlock, const uint8_t *trailer) {
+    uint8_t sector = MIFARE_BlockSector(trailerBlock);
+    uint8_t c1 = trailer[7] >> 4;
+    uint8_t c2 = trailer[8] & 0x0F;
+    uint8_t c3 = trailer[8] >> 4;
+    uint16_t packed = SECTOR_KNOWN;
+
+    // Cada nibble va acompañado de su complemento
+    if((trailer[6] & 0x0F) != (uint8_t)(~c1 & 0x0F) ||
+       (trailer[6] >> 4) != (uint8_t)(~c2 & 0x0F) ||
+       (trailer[7] & 0x0F) != (uint8_t)(~c3 & 0x0F)) {
+        return -1;
+    }
+
+    for(uint8_t g = 0; g < 4; g++) {
+        uint8_t c = (uint8_t)((((c1 >> g) & 1) << 2) | (((c2 >> g) & 1) << 1) | ((c3 >> g) & 1));
+        packed |= (uint16_t)c << (g * 3);
+    }
+    sector_access[sector] = packed;
+    return 0;
+}
+
+uint8_t Access_Known(uint8_t sector) {
+    return (sector_access[sector] & SECTOR_KNOWN) ? 1 : 0;
+}
+
+uint8_t Access_Keys(uint8_t blockAddr, uint8_t write) {
+    uint8_t sector = MIFARE_BlockSector(blockAddr);
+    uint16_t packed = sector_access[sector];
+    uint8_t group = block_group(blockAddr);
+    uint8_t c, keys;
+
+    if(!(packed & SECTOR_KNOWN)) {
+        return ACCESS_KEY_ANY;
+    }
+    c = (packed >> (group * 3)) & 0x07;
+    if(group == 3) {
+        keys = write ? trailer_write[c] : trailer_read[c];
+    } else {
+        keys = write ? data_write[c] : data_read[c];
+    }
+    if(KEYB_READABLE((packed >> 9) & 0x07)) {
+        keys &= (uint8_t)~ACCESS_KEY_B;
+    }
+    return keys;
+}
+
+uint8_t Access_KeyBit(uint8_t authMode) {
+    return (authMode == PICC_AUTHENT1B) ? ACCESS_KEY_B : ACCESS_KEY_A;
+}
+
+// =================== Planificación ===================
+
+static Access_Op sorted[ACCESS_MAX_OPS];
+
+static uint8_t op_after(const Access_Op *a, const Access_Op *b) {
+    uint8_t sa = MIFARE_BlockSector(a->block);
+    uint8_t sb = MIFARE_BlockSector(b->block);
+    if(sa != sb) {
+        return sa > sb;
+    }
+    if(a->write != b->write) {
+        return a->write > b->write;
+    }
+    return a->block > b->block;
+}
+
+int Access_Plan(Access_Op *ops, uint8_t n, Access_Step *steps, uint8_t maxSteps) {
+    uint8_t nsteps = 0;
+    uint8_t i, j, k;
+
+    if(n > ACCESS_MAX_OPS) {
+        return -1;
+    }
+
+    // Orden por sector, lecturas antes que escrituras y por bloque: las
+    // lecturas consecutivas van encadenadas y el trailer, si se lee, se
+    // conoce antes de la primera escritura
+    for(i = 1; i < n; i++) {
+        Access_Op op = ops[i];
+        for(j = i; j > 0 && op_after(&ops[j - 1], &op); j--) {
+            ops[j] = ops[j - 1];
+        }
+        ops[j] = op;
+    }
+
+    for(i = 0; i < n; i = j) {
+        uint8_t sector = MIFARE_BlockSector(ops[i].block);
+        uint8_t common = ACCESS_KEY_ANY;
+        uint8_t mode[3];            // Orden de los pasos: imposibles, A, B
+        uint8_t m = 0;
+
+        for(j = i; j < n && MIFARE_BlockSector(ops[j].block) == sector; j++) {
+            uint8_t keys = Access_Keys(ops[j].block, ops[j].write);
+            if(keys) {
+                common &= keys;
+            }
+        }
+
+        // Una clave común (A preferida) o un paso por clave
+        mode[m++] = 0;
+        if(common & ACCESS_KEY_A) {
+            mode[m++] = PICC_AUTHENT1A;
+        } else if(common & ACCESS_KEY_B) {
+            mode[m++] = PICC_AUTHENT1B;
+        } else {
+            mode[m++] = PICC_AUTHENT1A;
+            mode[m++] = PICC_AUTHENT1B;
+        }
+
+        // Partición estable del sector en pasos
+        uint8_t out = i;
+        for(k = 0; k < m; k++) {
+            uint8_t first = out;
+            for(uint8_t p = i; p < j; p++) {
+                uint8_t keys = Access_Keys(ops[p].block, ops[p].write);
+                uint8_t bit = mode[k] ? Access_KeyBit(mode[k]) : 0;
+                uint8_t take;
+                if(mode[k] == 0) {
+                    take = (keys == 0);
+                } else if(m == 3 && mode[k] == PICC_AUTHENT1A) {
+                    take = (keys & bit) != 0;                   // A primero
+                } else if(m == 3) {
+                    take = (keys == ACCESS_KEY_B);              // Solo B
+                } else {
+                    take = (keys != 0);
+                }
+                if(take) {
+                    sorted[out++] = ops[p];
+                }
+            }
+            if(out == first) {
+                continue;
+            }
+            if(nsteps >= maxSteps) {
+                return -1;
+            }
+            steps[nsteps].sector = sector;
+            steps[nsteps].authMode = mode[k];
+            steps[nsteps].first = first;
+            steps[nsteps].count = out - first;
+            nsteps++;
+        }
+        memcpy(&ops[i], &sorted[i], (j - i) * sizeof(Access_Op));
+    }
+
+    return nsteps;
+}
+
+// =================== Ejecución ===================
+
+static Access_Step plan[ACCESS_MAX_OPS];
+
+// Sesión Crypto1 abierta (sector y clave); sector 0xFF: ninguna
+static uint8_t cur_sector;
+static uint8_t cur_mode;
+static uint8_t cur_key[6];
+
+// Lecturas en curso con MIFARE_ReadBlocks (para read_handler)
+static Access_Op *run_ops;
+static uint8_t run_count;
+static MIFARE_BlockHandler run_handler;
+
+static uint8_t trailer_block(uint8_t sector) {
+    return MIFARE_SectorFirstBlock(sector) + MIFARE_SectorBlockCount(sector) - 1;
+}
+
+// NAK o auth fallido: la tarjeta cerró la sesión (queda en IDLE)
+static void lose_session(const RC522_Uid *card) {
+    cur_sector = 0xFF;
+    RC522_StopCrypto1();
+    RC522_SelectUid(card);
+}
+
+// authMode 0: cualquier clave (sector aún desconocido)
+static int run_auth(const RC522_Uid *card, uint8_t sector, uint8_t authMode) {
+    uint8_t mode;
+
+    if(cur_sector == sector && (authMode == 0 || cur_mode == authMode)) {
+        return 0;
+    }
+    stats.auths++;
+    if(Keys_AuthWith(card, MIFARE_SectorFirstBlock(sector), authMode, &mode, cur_key) < 0) {
+        lose_session(card);
+        return -1;
+    }
+    cur_sector = sector;
+    cur_mode = mode;
+    return 0;
+}
+
+// Escritura en un sector cuyo trailer no se ha leído en este plan
+static int learn_trailer(const RC522_Uid *card, uint8_t sector) {
+    uint8_t trailer[18];
+    uint8_t tb = trailer_block(sector);
+
+    stats.trailerReads++;
+    if(MIFARE_Read(tb, trailer) != 0) {
+        lose_session(card);
+        return -1;
+    }
+    Access_Learn(tb, trailer);
+    return 0;
+}
+
+static void read_handler(uint8_t blockAddr, const uint8_t *data) {
+    for(uint8_t i = 0; i < run_count; i++) {
+        if(run_ops[i].block == blockAddr) {
+            memcpy(run_ops[i].data, data, 16);
+            run_ops[i].result = 0;
+        }
+    }
+    if(blockAddr == trailer_block(MIFARE_BlockSector(blockAddr))) {
+        Access_Learn(blockAddr, data);
+    }
+    if(run_handler) {
+        run_handler(blockAddr, data);
+    }
+}
+
+// Bloques consecutivos: READ encadenados en la sesión abierta
+static void run_reads(const RC522_Uid *card, Access_Op *ops, uint8_t count) {
+    for(uint8_t i = 0; i < count; i++) {
+        ops[i].result = MIFARE_ERR;
+    }
+    run_ops = ops;
+    run_count = count;
+    if(MIFARE_ReadBlocks(ops[0].block, count, cur_mode, NULL, NULL, NULL, read_handler) != 0) {
+        lose_session(card);
+    }
+}
+
+// En la sesión abierta; tras un NAK, reselect y un reintento con la misma clave
+static int run_write(const RC522_Uid *card, Access_Op *op, uint8_t verify) {
+    int result = MIFARE_WriteInSession(op->block, op->data, verify, cur_mode, cur_key,
+                                       (uint8_t *)&card->uid[card->size - 4]);
+
+    if(result != 0 && result != MIFARE_VERIFY_FAIL) {
+        lose_session(card);
+    }
+    return result;
+}
+
+int Access_Run(const RC522_Uid *card, Access_Op *ops, uint8_t n, uint8_t verify,
+               MIFARE_BlockHandler handler) {
+    int nsteps = Access_Plan(ops, n, plan, ACCESS_MAX_OPS);
+    int failed = 0;
+
+    if(nsteps < 0) {
+        return n;
+    }
+    cur_sector = 0xFF;
+    cur_mode = 0;
+    run_handler = handler;
+
+    for(int s = 0; s < nsteps; s++) {
+        Access_Step *st = &plan[s];
+        Access_Op *op = &ops[st->first];
+        uint8_t k = 0;
+
+        while(k < st->count) {
+            uint8_t keys = Access_Keys(op[k].block, op[k].write);
+            uint8_t m = 1;
+
+            if(st->authMode == 0 || keys == 0) {
+                op[k].result = ACCESS_DENIED;
+                stats.rejected++;
+                failed++;
+                k++;
+                continue;
+            }
+
+            // Un auth por paso: con cualquier clave si el sector no se
+            // conoce (la que funcione queda en cur_mode)
+            if(run_auth(card, st->sector, Access_Known(st->sector) ? st->authMode : 0) != 0) {
+                for(; k < st->count; k++) {
+                    op[k].result = ACCESS_AUTH_FAIL;
+                    failed++;
+                }
+                break;
+            }
+            if(op[k].write && !Access_Known(st->sector) && learn_trailer(card, st->sector) != 0) {
+                op[k].result = MIFARE_ERR;
+                failed++;
+                k++;
+                continue;
+            }
+
+            // El trailer puede exigir la otra clave: auth anidado con ella
+            keys = Access_Keys(op[k].block, op[k].write);
+            if(keys == 0) {
+                continue;                   // Denegada en la siguiente vuelta
+            }
+            if(!(keys & Access_KeyBit(cur_mode)) &&
+               run_auth(card, st->sector, (keys & ACCESS_KEY_A) ? PICC_AUTHENT1A : PICC_AUTHENT1B) != 0) {
+                op[k].result = ACCESS_AUTH_FAIL;
+                failed++;
+                k++;
+                continue;
+            }
+
+            if(op[k].write) {
+                op[k].result = (int8_t)run_write(card, &op[k], verify);
+            } else {
+                while(k + m < st->count && !op[k + m].write &&
+                      op[k + m].block == op[k].block + m &&
+                      (Access_Keys(op[k + m].block, ACCESS_READ) & Access_KeyBit(cur_mode))) {
+                    m++;
+                }
+                run_reads(card, &op[k], m);
+            }
+            for(uint8_t i = 0; i < m; i++) {
+                failed += (op[k + i].result != 0);
+            }
+            k += m;
+        }
+    }
+
+    return failed;
+}
+
+const Access_Stats *Access_GetStats(void) {
+    return &stats;
+}
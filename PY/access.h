@@ -0,0 +1,79 @@
+#ifndef ACCESS_H
+#define ACCESS_H
+
+#include <stdint.h>
+#include "rc522.h"
+#include "mifare.h"
+
+// ===== Planificador de accesos MIFARE Classic =====
+// Condiciones de acceso de cada sector (bytes 6-8 del trailer) leídas una
+// vez por sesión de tarjeta. Con ellas se agrupan las operaciones por
+// sector y tipo de clave: un auth por (sector, clave) y nunca un WRITE
+// con una clave que el trailer no permite (NAK + reselect).
+#define ACCESS_KEY_A        0x01
+#define ACCESS_KEY_B        0x02
+#define ACCESS_KEY_ANY      (ACCESS_KEY_A | ACCESS_KEY_B)
+
+#define ACCESS_READ         0
+#define ACCESS_WRITE        1
+
+// Resultados de Access_Run además de los MIFARE_*
+#define ACCESS_AUTH_FAIL    (-4)    // Ninguna clave autenticó el sector
+#define ACCESS_DENIED       (-5)    // El trailer no lo permite con ninguna clave
+
+#ifndef ACCESS_MAX_OPS
+#define ACCESS_MAX_OPS      32
+#endif
+
+// Operación sobre un bloque; data: 16 bytes (destino o datos a escribir)
+typedef struct {
+    uint8_t block;
+    uint8_t write;           // ACCESS_READ / ACCESS_WRITE
+    uint8_t *data;
+    int8_t result;           // Tras Access_Run: 0 o código MIFARE_*
+} Access_Op;
+
+// Paso del plan: un auth con authMode y las operaciones ops[first..first+count)
+// (authMode 0: ninguna clave lo permite, no se intentan)
+typedef struct {
+    uint8_t sector;
+    uint8_t authMode;
+    uint8_t first;
+    uint8_t count;
+} Access_Step;
+
+typedef struct {
+    uint32_t auths;          // Autenticaciones de Access_Run
+    uint32_t trailerReads;   // Trailers leídos para conocer el sector
+    uint32_t rejected;       // Operaciones que el trailer no permite
+} Access_Stats;
+
+// ===== Funciones =====
+// Nueva tarjeta: olvida las condiciones de acceso
+extern void Access_Reset(void);
+
+// Guardar las condiciones de un trailer leído; -1 si los bits no son coherentes
+extern int Access_Learn(uint8_t trailerBlock, const uint8_t *trailer);
+extern uint8_t Access_Known(uint8_t sector);
+
+// Claves (ACCESS_KEY_*) que permiten la operación; ACCESS_KEY_ANY si
+// el trailer del sector aún no se conoce
+extern uint8_t Access_Keys(uint8_t blockAddr, uint8_t write);
+extern uint8_t Access_KeyBit(uint8_t authMode);
+
+// Ordena ops por bloque y calcula los pasos mínimos; devuelve su número
+// o -1 si no caben en maxSteps
+extern int Access_Plan(Access_Op *ops, uint8_t n, Access_Step *steps, uint8_t maxSteps);
+
+// Ejecuta el plan en la tarjeta seleccionada. En un sector desconocido el
+// primer auth prueba cualquier clave y el trailer se aprende al leerlo (o
+// se lee antes de la primera escritura); si exige la otra clave, auth
+// anidado. Las lecturas de bloques consecutivos van encadenadas y cada
+// bloque se entrega a handler (puede ser NULL) con el siguiente READ en
+// curso. La última sesión queda abierta. Devuelve las operaciones fallidas
+extern int Access_Run(const RC522_Uid *card, Access_Op *ops, uint8_t n, uint8_t verify,
+                      MIFARE_BlockHandler handler);
+
+extern const Access_Stats *Access_GetStats(void);
+
+#endif
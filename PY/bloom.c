@@ -0,0 +1,75 @@
+#include <string.h>
+#include "bloom.h"
+#include "whitelist.h"
+
+static const Bloom_Header *const header = (const Bloom_Header *)BLOOM_ADDR;
+static const uint32_t *const bitmap = (const uint32_t *)(BLOOM_ADDR + sizeof(Bloom_Header));
+
+static uint8_t valid = 0;
+
+// FNV-1a de 32 bits sobre tamaño + UID
+static uint32_t bloom_hash(const RC522_Uid *card) {
+    uint32_t h = 2166136261UL;
+    h = (h ^ card->size) * 16777619UL;
+    for(uint8_t i = 0; i < card->size; i++) {
+        h = (h ^ card->uid[i]) * 16777619UL;
+    }
+    return h;
+}
+
+// Finalizador de MurmurHash3: segundo hash independiente del primero
+static uint32_t bloom_mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85EBCA6BUL;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35UL;
+    h ^= h >> 16;
+    return h;
+}
+
+int Bloom_Init(void) {
+    valid = 0;
+
+    if(header->magic != BLOOM_MAGIC || header->bits == 0 || header->bits > BLOOM_MAX_BITS ||
+       header->hashes == 0 || header->hashes > BLOOM_MAX_HASHES) {
+        return -1;
+    }
+    if(Whitelist_CRC(bitmap, ((header->bits + 31) / 32) * 4) != header->crc) {
+        return -1;
+    }
+
+    valid = 1;
+    return 0;
+}
+
+uint8_t Bloom_Valid(void) {
+    return valid;
+}
+
+uint32_t Bloom_Count(void) {
+    return valid ? header->count : 0;
+}
+
+uint32_t Bloom_Version(void) {
+    return valid ? header->version : 0;
+}
+
+uint8_t Bloom_Revoked(const RC522_Uid *card) {
+    uint32_t m, h1, h2;
+
+    if(!valid) {
+        return 0;
+    }
+    m = header->bits;
+    h1 = bloom_hash(card);
+    h2 = bloom_mix(h1) | 1;        // Impar: recorre todos los bits
+
+    // Doble hash (Kirsch-Mitzenmacher): bit_i = (h1 + i * h2) mod m
+    for(uint32_t i = 0; i < header->hashes; i++) {
+        uint32_t bit = (h1 + i * h2) % m;
+        if(!(bitmap[bit >> 5] & (1UL << (bit & 31)))) {
+            return 0;
+        }
+    }
+    return 1;
+}
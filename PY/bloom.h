@@ -0,0 +1,41 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stdint.h>
+#include "rc522.h"
+
+// ===== Filtro de Bloom de tarjetas revocadas =====
+// Imagen en el sector 3 (16 KB, justo después del firmware: el código
+// debe caber en los sectores 0-2). La genera tools/imagegen.py a partir
+// de la lista de revocadas y la tasa de falsos positivos elegida; con
+// 1 % caben ~13 000 UIDs. Consulta en tiempo constante: k bits con doble
+// hash (FNV-1a y su mezcla) sobre el tamaño y los bytes del UID.
+#define BLOOM_ADDR          0x0800C000UL
+#define BLOOM_SIZE          0x4000UL
+#define BLOOM_MAGIC         0x314D4C42UL    // "BLM1"
+#define BLOOM_MAX_HASHES    16
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;        // Versión del conjunto (la asigna el servidor)
+    uint32_t bits;           // m: bits del filtro
+    uint32_t hashes;         // k: bits por UID
+    uint32_t count;          // UIDs insertados (informativo)
+    uint32_t crc;            // CRC-32 STM32 del mapa de bits (ceil(m/32) palabras)
+} Bloom_Header;
+
+#define BLOOM_MAX_BITS      ((BLOOM_SIZE - sizeof(Bloom_Header)) * 8)
+
+// ===== Funciones =====
+// Comprueba la imagen; 0 si es válida, -1 si no (no se revoca nada:
+// sin imagen sigue decidiendo la lista blanca)
+extern int Bloom_Init(void);
+
+extern uint8_t Bloom_Valid(void);
+extern uint32_t Bloom_Count(void);
+extern uint32_t Bloom_Version(void);
+
+// 1 si el UID puede estar revocado (sin falsos negativos)
+extern uint8_t Bloom_Revoked(const RC522_Uid *card);
+
+#endif
@@ -8,6 +8,7 @@
 // PA6 : MISO
 // PA7 : MOSI
 // PA8 : Reset RC522
+// PA0 : IRQ RC522 (EXTI0, activo en bajo)
 
 void confRCC(void) {
     RCC->AHB1ENR |= (1 << 0) | (1 << 2); // GPIOA y GPIOC
@@ -20,6 +21,9 @@ void confRCC(void) {
     
     // Reloj USART1 (NodeMCU)
     RCC->APB2ENR |= (1 << 4);
+    
+    // Reloj DMA2 (ráfagas SPI1)
+    RCC->AHB1ENR |= (1 << 22);
 }
 
 void confGPIO(void) {
@@ -45,6 +49,11 @@ void confGPIO(void) {
     GPIOA->PUPDR &= ~(3 << (2*8));      // Sin pull-up/pull-down
     GPIOA->BSRR = (1 << 8);             // Establecer alto
     
+    // ===== PA0 como IRQ del RC522 (Entrada) =====
+    GPIOA->MODER &= ~(3 << (2*0));      // Modo entrada
+    GPIOA->PUPDR &= ~(3 << (2*0));
+    GPIOA->PUPDR |= (1 << (2*0));       // Pull-up (línea activa en bajo)
+    
     // LED en PC13
     GPIOC->MODER &= ~(3 << (2*13));
     GPIOC->MODER |= (1<<(2*13));
@@ -78,7 +87,7 @@ void confSPI(void) {
     
     // 4. Velocidad: APB2/32 = 90MHz/32 = 2.8MHz
     SPI1->CR1 &= ~SPI_CR1_BR;    // Limpiar bits BR
-    SPI1->CR1 |= (4 << 3);       // BR[2:0] = 100 = /32
+    SPI1->CR1 |= (SPI_BR_DEFAULT << 3);  // BR[2:0] = 100 = /32
     
     // 5. NSS software (CS control manual)
     SPI1->CR1 |= SPI_CR1_SSM | SPI_CR1_SSI;
@@ -89,13 +98,79 @@ void confSPI(void) {
     // 7. Modo full duplex
     SPI1->CR1 &= ~SPI_CR1_RXONLY;
     
-    // 8. Datos de 8 bits
+    // 8. Datos de 8 bits (o 16, ver SPI_DEFAULT_MODE)
     SPI1->CR1 &= ~SPI_CR1_DFF;
+    if(SPI_DEFAULT_MODE == SPI_MODE_16BIT) {
+        SPI1->CR1 |= SPI_CR1_DFF;
+    }
     
     // 9. Habilitar SPI
     SPI1->CR1 |= SPI_CR1_SPE;
 }
 
+void confSPIMode(uint8_t mode) {
+    // DFF solo se puede cambiar con el SPI deshabilitado
+    while(SPI1->SR & SPI_SR_BSY);
+    SPI1->CR1 &= ~SPI_CR1_SPE;
+    
+    if(mode == SPI_MODE_16BIT) {
+        SPI1->CR1 |= SPI_CR1_DFF;    // Tramas de 16 bits
+    } else {
+        SPI1->CR1 &= ~SPI_CR1_DFF;   // Tramas de 8 bits
+    }
+    
+    SPI1->CR1 |= SPI_CR1_SPE;
+}
+
+void confEXTI(void) {
+    // EXTI0 <- PA0 (IRQ del RC522), flanco de bajada
+    RCC->APB2ENR |= RCC_APB2ENR_SYSCFGEN;
+    
+    SYSCFG->EXTICR[0] &= ~SYSCFG_EXTICR1_EXTI0;   // EXTI0 = PA0
+    EXTI->FTSR |= EXTI_FTSR_TR0;                  // Flanco de bajada
+    EXTI->RTSR &= ~EXTI_RTSR_TR0;
+    EXTI->PR = EXTI_PR_PR0;                       // Limpiar pendiente
+    EXTI->IMR |= EXTI_IMR_MR0;                    // Desenmascarar
+    
+    NVIC_EnableIRQ(EXTI0_IRQn);
+}
+
+void confDMA(void) {
+    // DMA2 para ráfagas FIFO del RC522
+    // SPI1_RX: Stream0 canal 3 / SPI1_TX: Stream3 canal 3
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA2EN;
+    
+    // 1. Deshabilitar streams antes de configurar
+    DMA2_Stream0->CR = 0;
+    DMA2_Stream3->CR = 0;
+    while((DMA2_Stream0->CR & DMA_SxCR_EN) || (DMA2_Stream3->CR & DMA_SxCR_EN));
+    
+    // 2. Dirección de periférico: registro de datos SPI1
+    DMA2_Stream0->PAR = (uint32_t)&SPI1->DR;
+    DMA2_Stream3->PAR = (uint32_t)&SPI1->DR;
+    
+    // 3. RX: periférico -> memoria, incremento de memoria, 8 bits
+    DMA2_Stream0->CR = (3 << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_MINC | DMA_SxCR_PL_1;
+    
+    // 4. TX: memoria -> periférico, incremento de memoria, 8 bits
+    DMA2_Stream3->CR = (3 << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_MINC | DMA_SxCR_DIR_0;
+    
+    // 5. Modo directo (sin FIFO del DMA)
+    DMA2_Stream0->FCR = 0;
+    DMA2_Stream3->FCR = 0;
+}
+
+void confSPIPrescaler(uint8_t br) {
+    // BR solo se debe cambiar sin transferencias en curso
+    while(SPI1->SR & SPI_SR_BSY);
+    SPI1->CR1 &= ~SPI_CR1_SPE;
+    
+    SPI1->CR1 &= ~SPI_CR1_BR;
+    SPI1->CR1 |= ((br & 0x07) << 3);
+    
+    SPI1->CR1 |= SPI_CR1_SPE;
+}
+
 void confUSART(void) {
     // Reloj del sistema: 180MHz
     // Reloj APB1 (USART2): 180MHz / 4 = 45MHz
@@ -113,9 +188,11 @@ void confUSART(void) {
     USART1->CR1 = 0;  // Limpiar primero
     USART1->CR1 |= (1<<3)     // HABILITAR TX
                 |(1<<2)     // HABILITAR RX
+                |(1<<5)     // Interrupción RXNE (cola de recepción)
                 |(1<<13);   // HABILITAR USART
     // BRR = 90,000,000 / 9600 = 9375 = 0x249F
     USART1->BRR = 0x249F;    // 9600 baud @ 90MHz APB2
+    NVIC_EnableIRQ(USART1_IRQn);
 }
 
 void confALL(void) {
@@ -123,4 +200,6 @@ void confALL(void) {
     confGPIO();
     confUSART();
     confSPI();
+    confDMA();
+    confEXTI();
 }
@@ -3,11 +3,29 @@
 
 #include <stm32f446xx.h>
 
+// ===== Modo de trama SPI1 =====
+// 8 bits: dirección y dato en dos tramas; 16 bits: acceso de registro en
+// una sola trama (las ráfagas FIFO vuelven a 8 bits temporalmente)
+#define SPI_MODE_8BIT       0
+#define SPI_MODE_16BIT      1
+
+#ifndef SPI_DEFAULT_MODE
+#define SPI_DEFAULT_MODE    SPI_MODE_16BIT
+#endif
+
+// ===== Reloj SPI1 =====
+// BR[2:0] de SPI_CR1: SCK = APB2 / 2^(BR+1), APB2 = 90 MHz
+#define SPI_BR_DEFAULT      4       // /32 = 2.8 MHz
+
 // ===== Funciones de configuración =====
 extern void confRCC(void);
 extern void confGPIO(void);
 extern void confUSART(void);
 extern void confSPI(void);
+extern void confSPIMode(uint8_t mode);
+extern void confSPIPrescaler(uint8_t br);
+extern void confDMA(void);
+extern void confEXTI(void);
 extern void confALL(void);
 
 #endif
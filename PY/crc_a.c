@@ -0,0 +1,49 @@
+#include "crc_a.h"
+
+static uint16_t crc_a_table[4][256];
+static uint8_t crc_a_ready = 0;
+
+void CRC_A_Init(void) {
+    for(uint16_t i = 0; i < 256; i++) {
+        uint16_t crc = i;
+        for(uint8_t b = 0; b < 8; b++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC_A_POLY : (crc >> 1);
+        }
+        crc_a_table[0][i] = crc;
+    }
+    
+    // Tabla k: efecto de un byte seguido de k bytes a cero
+    for(uint16_t i = 0; i < 256; i++) {
+        for(uint8_t k = 1; k < 4; k++) {
+            uint16_t prev = crc_a_table[k - 1][i];
+            crc_a_table[k][i] = (prev >> 8) ^ crc_a_table[0][prev & 0xFF];
+        }
+    }
+    
+    crc_a_ready = 1;
+}
+
+void CRC_A_Calculate(const uint8_t *data, uint16_t len, uint8_t *result) {
+    uint16_t crc = CRC_A_INIT;
+    
+    if(!crc_a_ready) {
+        CRC_A_Init();
+    }
+    
+    // Bloques de 4 bytes: los dos primeros se mezclan con el CRC actual
+    while(len >= 4) {
+        uint16_t x = crc ^ (uint16_t)(data[0] | (data[1] << 8));
+        crc = crc_a_table[3][x & 0xFF] ^ crc_a_table[2][x >> 8] ^
+              crc_a_table[1][data[2]] ^ crc_a_table[0][data[3]];
+        data += 4;
+        len -= 4;
+    }
+    
+    // Resto byte a byte
+    while(len--) {
+        crc = (crc >> 8) ^ crc_a_table[0][(crc ^ *data++) & 0xFF];
+    }
+    
+    result[0] = (uint8_t)(crc & 0xFF);
+    result[1] = (uint8_t)(crc >> 8);
+}
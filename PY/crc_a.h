@@ -0,0 +1,21 @@
+#ifndef CRC_A_H
+#define CRC_A_H
+
+#include <stdint.h>
+
+// ===== CRC_A (ISO/IEC 14443-3) =====
+// Polinomio x^16 + x^12 + x^5 + 1 reflejado (0x8408), valor inicial
+// 0x6363, sin XOR final. Tablas slice-by-4 (4 bytes por iteración) en RAM.
+// Sin dependencias del hardware: tools/crccheck.c lo compila en el PC y
+// lo compara con el cálculo bit a bit.
+#define CRC_A_POLY      0x8408
+#define CRC_A_INIT      0x6363
+
+// ===== Funciones =====
+// Genera las tablas (CRC_A_Calculate lo hace si no se ha llamado)
+extern void CRC_A_Init(void);
+
+// Resultado little-endian, igual que CRCResultRegL/H del RC522
+extern void CRC_A_Calculate(const uint8_t *data, uint16_t len, uint8_t *result);
+
+#endif
@@ -0,0 +1,69 @@
+#include <stm32f446xx.h>
+#include "flash.h"
+#include "timing.h"
+
+#define FLASH_KEY1          0x45670123UL
+#define FLASH_KEY2          0xCDEF89ABUL
+
+#define FLASH_SR_ERRORS     (FLASH_SR_OPERR | FLASH_SR_WRPERR | FLASH_SR_PGAERR | \
+                             FLASH_SR_PGPERR | FLASH_SR_PGSERR)
+
+void Flash_Unlock(void) {
+    if(FLASH->CR & FLASH_CR_LOCK) {
+        FLASH->KEYR = FLASH_KEY1;
+        FLASH->KEYR = FLASH_KEY2;
+    }
+}
+
+void Flash_Lock(void) {
+    FLASH->CR |= FLASH_CR_LOCK;
+}
+
+static int flash_wait(void) {
+    while(FLASH->SR & FLASH_SR_BSY);
+    if(FLASH->SR & FLASH_SR_ERRORS) {
+        FLASH->SR = FLASH_SR_ERRORS;        // Se limpian escribiendo 1
+        return -1;
+    }
+    return 0;
+}
+
+int Flash_EraseSector(uint8_t sector) {
+    int result;
+
+    flash_wait();
+    FLASH->CR = (FLASH->CR & ~(FLASH_CR_SNB | FLASH_CR_PSIZE | FLASH_CR_PG))
+              | FLASH_CR_SER | ((uint32_t)sector << FLASH_CR_SNB_Pos)
+              | FLASH_CR_PSIZE_1;           // x32 (VDD 2.7-3.6 V)
+    Timing_StallBegin();
+    FLASH->CR |= FLASH_CR_STRT;
+    result = flash_wait();
+    Timing_StallEnd();
+    FLASH->CR &= ~(FLASH_CR_SER | FLASH_CR_SNB);
+    return result;
+}
+
+int Flash_ProgramWord(uint32_t addr, uint32_t word) {
+    int result;
+
+    flash_wait();
+    FLASH->CR = (FLASH->CR & ~(FLASH_CR_PSIZE | FLASH_CR_SER)) | FLASH_CR_PSIZE_1 | FLASH_CR_PG;
+    *(volatile uint32_t *)addr = word;
+    result = flash_wait();
+    FLASH->CR &= ~FLASH_CR_PG;
+
+    if(result == 0 && *(volatile uint32_t *)addr != word) {
+        result = -1;
+    }
+    return result;
+}
+
+uint8_t Flash_IsBlank(uint32_t addr, uint32_t len) {
+    const uint32_t *w = (const uint32_t *)addr;
+    for(uint32_t i = 0; i < len / 4; i++) {
+        if(w[i] != 0xFFFFFFFFUL) {
+            return 0;
+        }
+    }
+    return 1;
+}
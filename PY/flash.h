@@ -0,0 +1,32 @@
+#ifndef FLASH_H
+#define FLASH_H
+
+#include <stdint.h>
+
+// ===== Mapa de la flash interna (512 KB) =====
+// Sectores 0-2:  firmware (48 KB, límite del enlazador en PY.sct)
+// Sector 3:      filtro de Bloom de revocadas (16 KB)
+// Sectores 4-5:  diario de accesos (64 KB + 128 KB)
+// Sectores 6-7:  lista blanca, bancos A y B (128 KB cada uno)
+#define FLASH_SECTOR_BLOOM      3
+#define FLASH_SECTOR_WL_A       6
+#define FLASH_SECTOR_WL_B       7
+
+// Mientras dura un borrado o una programación la CPU no puede leer la
+// flash: el código y las interrupciones se detienen (1-2 s por sector de
+// 128 KB, ~16 us por palabra). Flash_EraseSector corrige millis() al
+// terminar (Timing_StallEnd), pero lo que llegue por USART1 durante el
+// borrado se pierde: quien envía debe esperar la respuesta y reintentar
+
+// ===== Funciones =====
+extern void Flash_Unlock(void);
+extern void Flash_Lock(void);
+
+// 0 si correcto, -1 si FLASH->SR indica error
+extern int Flash_EraseSector(uint8_t sector);
+extern int Flash_ProgramWord(uint32_t addr, uint32_t word);
+
+// 1 si len bytes desde addr están borrados (0xFF)
+extern uint8_t Flash_IsBlank(uint32_t addr, uint32_t len);
+
+#endif
@@ -0,0 +1,602 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "journal.h"
+#include "whitelist.h"
+#include "flash.h"
+#include "usart.h"
+#include "timing.h"
+#include "sync.h"
+
+#define SLOT        sizeof(Journal_Record)
+
+static const struct {
+    uint32_t addr;
+    uint32_t size;
+    uint8_t sector;
+} segs[2] = {
+    { JOURNAL_SEG0_ADDR, JOURNAL_SEG0_SIZE, 4 },
+    { JOURNAL_SEG1_ADDR, JOURNAL_SEG1_SIZE, 5 },
+};
+
+// Cabecera de segmento: ocupa la primera ranura. Los dos campos del
+// índice quedan en blanco hasta que se sella el segmento.
+//
+//   [cabecera][registros: seg_cap ranuras][índice: seg_cap palabras]
+typedef struct {
+    uint32_t magic;
+    uint32_t generation;
+    uint32_t indexCount;
+    uint32_t indexMagic;
+} journal_seg_t;
+
+// Índice del segmento mayor mientras se ordena (solo al sellar)
+#define INDEX_MAX   ((JOURNAL_SEG1_SIZE - SLOT) / (SLOT + 4))
+static uint32_t index_buf[INDEX_MAX];
+
+static uint8_t cur;                     // Segmento en escritura
+static uint8_t older_valid;             // El otro tiene la generación anterior
+static uint32_t generation;
+static uint32_t write_addr;
+static uint8_t full;
+
+static Journal_Record queue[JOURNAL_QUEUE];
+static uint8_t q_tail, q_count;
+
+static uint32_t next_seq = 1;
+static uint16_t boot = 1;
+static uint32_t acked;
+static uint32_t persisted_ack;
+static uint8_t ack_rewrite;             // Los registros ACK se borraron al reciclar
+
+// Reenvío: primer evento sin ACK y siguiente a enviar (0: ninguno)
+static uint32_t unacked_addr;
+static uint32_t fwd_addr;
+static uint8_t outstanding;
+static uint32_t last_send;
+
+static Journal_Stats stats;
+
+// Consulta en curso: segmento y posición (entrada del índice si está
+// sellado, dirección del registro si no)
+static struct {
+    uint8_t active;
+    uint8_t size;
+    uint8_t uid[10];
+    uint16_t key;
+    uint32_t since;
+    uint8_t seg;
+    uint32_t pos;
+    uint32_t found;
+} query;
+
+// =================== Ranuras ===================
+
+static const Journal_Record *rec_at(uint32_t addr) {
+    return (const Journal_Record *)addr;
+}
+
+static const journal_seg_t *seg_header(uint8_t s) {
+    return (const journal_seg_t *)segs[s].addr;
+}
+
+// Ranuras de registro: el resto del segmento es para el índice
+static uint32_t seg_cap(uint8_t s) {
+    return (segs[s].size - SLOT) / (SLOT + 4);
+}
+
+static uint32_t rec_end(uint8_t s) {
+    return segs[s].addr + SLOT + seg_cap(s) * SLOT;
+}
+
+static const uint32_t *seg_index(uint8_t s) {
+    return (const uint32_t *)rec_end(s);
+}
+
+static uint8_t seg_sealed(uint8_t s) {
+    return seg_header(s)->indexMagic == JOURNAL_INDEX_MAGIC &&
+           seg_header(s)->indexCount <= seg_cap(s);
+}
+
+static int8_t hex_nibble(char c) {
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static uint8_t slot_blank(uint32_t addr) {
+    return Flash_IsBlank(addr, SLOT);
+}
+
+static uint32_t rec_crc(const Journal_Record *r) {
+    return Whitelist_CRC(r, SLOT - 4);
+}
+
+static uint8_t rec_valid(const Journal_Record *r) {
+    return r->crc == rec_crc(r);
+}
+
+// Clave de índice: 16 bits altos del FNV-1a del UID (las colisiones se
+// descartan comparando el registro)
+static uint16_t uid_key(const uint8_t *uid, uint8_t size) {
+    return (uint16_t)(Journal_Hash(uid, size) >> 16);
+}
+
+// Primera ranura en orden cronológico (0: diario vacío)
+static uint32_t first_slot(void) {
+    uint8_t old = cur ^ 1;
+    if(older_valid && !slot_blank(segs[old].addr + SLOT)) {
+        return segs[old].addr + SLOT;
+    }
+    return (segs[cur].addr + SLOT < write_addr) ? segs[cur].addr + SLOT : 0;
+}
+
+// Ranura siguiente en orden cronológico (0: posición de escritura)
+static uint32_t next_slot(uint32_t addr) {
+    uint8_t s = (addr >= segs[1].addr) ? 1 : 0;
+
+    addr += SLOT;
+    if(s == cur) {
+        return (addr < write_addr) ? addr : 0;
+    }
+    if(addr < rec_end(s) && !slot_blank(addr)) {
+        return addr;
+    }
+    addr = segs[cur].addr + SLOT;
+    return (addr < write_addr) ? addr : 0;
+}
+
+// Primer evento válido sin confirmar desde addr (incluida)
+static uint32_t find_unacked(uint32_t addr) {
+    for(; addr; addr = next_slot(addr)) {
+        const Journal_Record *r = rec_at(addr);
+        if(r->type == JOURNAL_EVENT && r->seq > acked && rec_valid(r)) {
+            return addr;
+        }
+    }
+    return 0;
+}
+
+// =================== Escritura ===================
+
+static int seg_start(uint8_t s, uint32_t gen) {
+    int result;
+
+    Flash_Unlock();
+    result = Flash_EraseSector(segs[s].sector);
+    if(result == 0) {
+        result = Flash_ProgramWord(segs[s].addr + 4, gen);
+    }
+    if(result == 0) {
+        result = Flash_ProgramWord(segs[s].addr, JOURNAL_MAGIC);
+    }
+    Flash_Lock();
+    return result;
+}
+
+static void program_record(const Journal_Record *r) {
+    const uint32_t *w = (const uint32_t *)r;
+    uint32_t addr = write_addr;
+    int result = 0;
+
+    Flash_Unlock();
+    for(uint8_t i = 0; i < SLOT / 4 && result == 0; i++) {
+        result = Flash_ProgramWord(addr + i * 4, w[i]);
+    }
+    Flash_Lock();
+
+    // Una ranura que falla queda inválida (CRC) y se salta
+    write_addr += SLOT;
+    full = (write_addr >= rec_end(cur));
+    if(result != 0 || r->type != JOURNAL_EVENT) {
+        return;
+    }
+    if(unacked_addr == 0) {
+        unacked_addr = addr;
+    }
+    if(fwd_addr == 0) {
+        fwd_addr = addr;
+    }
+}
+
+static void sort_index(uint32_t *a, uint32_t n) {
+    uint32_t gap = 1;
+
+    // Shell sort: sin recursión ni memoria extra (pila de 1 KB)
+    while(gap < n / 3) {
+        gap = gap * 3 + 1;
+    }
+    for(; gap > 0; gap /= 3) {
+        for(uint32_t i = gap; i < n; i++) {
+            uint32_t v = a[i];
+            uint32_t j = i;
+            while(j >= gap && a[j - gap] > v) {
+                a[j] = a[j - gap];
+                j -= gap;
+            }
+            a[j] = v;
+        }
+    }
+}
+
+// Índice del segmento lleno: ~60 ms de programación para el mayor
+static void seal(uint8_t s) {
+    uint32_t first = segs[s].addr + SLOT;
+    uint32_t n = 0;
+    int result = 0;
+
+    // Un sellado cortado deja el segmento sin índice (recorrido lineal)
+    if(seg_sealed(s) || seg_header(s)->indexCount != 0xFFFFFFFFUL ||
+       !Flash_IsBlank(rec_end(s), seg_cap(s) * 4)) {
+        return;
+    }
+
+    for(uint32_t a = first; a < rec_end(s); a += SLOT) {
+        const Journal_Record *r = rec_at(a);
+        if(r->type == JOURNAL_EVENT && rec_valid(r)) {
+            index_buf[n++] = ((uint32_t)uid_key(r->uid, r->uidSize) << 16) | ((a - first) / SLOT);
+        }
+    }
+    sort_index(index_buf, n);
+
+    Flash_Unlock();
+    for(uint32_t i = 0; i < n && result == 0; i++) {
+        result = Flash_ProgramWord(rec_end(s) + i * 4, index_buf[i]);
+    }
+    if(result == 0) {
+        result = Flash_ProgramWord(segs[s].addr + 8, n);
+    }
+    if(result == 0) {
+        Flash_ProgramWord(segs[s].addr + 12, JOURNAL_INDEX_MAGIC);
+    }
+    Flash_Lock();
+}
+
+static void query_end(const char *suffix) {
+    char msg[40];
+    sprintf(msg, "LOG:QEND:%u%s\r\n", (unsigned int)query.found, suffix);
+    USART1_SendString(msg);
+    query.active = 0;
+}
+
+// Segmento lleno: borrar el más antiguo y seguir en él
+static void recycle(void) {
+    uint8_t old = cur ^ 1;
+
+    // Eventos sin confirmar que se pierden con el segmento antiguo
+    if(older_valid) {
+        for(uint32_t a = unacked_addr; a && a < rec_end(old) && a >= segs[old].addr; a = next_slot(a)) {
+            const Journal_Record *r = rec_at(a);
+            if(r->type == JOURNAL_EVENT && r->seq > acked) {
+                stats.lost++;
+            }
+        }
+    }
+
+    if(seg_start(old, generation + 1) != 0) {
+        return;                             // Se reintenta en el siguiente reposo
+    }
+    if(query.active && query.seg == old) {
+        query_end(":ABORT");
+    }
+    generation++;
+    cur = old;
+    older_valid = 1;
+    write_addr = segs[cur].addr + SLOT;
+    full = 0;
+
+    unacked_addr = find_unacked(first_slot());
+    fwd_addr = unacked_addr;
+    outstanding = 0;
+    ack_rewrite = (acked != 0);
+}
+
+// =================== Interfaz ===================
+
+void Journal_Init(void) {
+    uint8_t v0 = (seg_header(0)->magic == JOURNAL_MAGIC);
+    uint8_t v1 = (seg_header(1)->magic == JOURNAL_MAGIC);
+    uint32_t maxSeq = 0;
+    uint16_t maxBoot = 0;
+
+    if(!v0 && !v1) {
+        // Primer arranque: el borrado para la CPU 1-2 s, aún sin sondeo
+        cur = 0;
+        generation = 1;
+        older_valid = 0;
+        if(!Flash_IsBlank(segs[0].addr, segs[0].size)) {
+            seg_start(0, generation);
+        } else {
+            Flash_Unlock();
+            Flash_ProgramWord(segs[0].addr + 4, generation);
+            Flash_ProgramWord(segs[0].addr, JOURNAL_MAGIC);
+            Flash_Lock();
+        }
+    } else {
+        cur = (v1 && (!v0 || seg_header(1)->generation > seg_header(0)->generation)) ? 1 : 0;
+        generation = seg_header(cur)->generation;
+        older_valid = (v0 && v1 && seg_header(cur ^ 1)->generation + 1 == generation);
+    }
+
+    // Posición de escritura: primera ranura en blanco
+    write_addr = segs[cur].addr + SLOT;
+    while(write_addr < rec_end(cur) && !slot_blank(write_addr)) {
+        write_addr += SLOT;
+    }
+    full = (write_addr >= rec_end(cur));
+
+    // Secuencia, último ACK y número de arranque
+    for(uint32_t a = first_slot(); a; a = next_slot(a)) {
+        const Journal_Record *r = rec_at(a);
+        if(!rec_valid(r)) {
+            continue;
+        }
+        if(r->type == JOURNAL_ACK && r->seq > acked) {
+            acked = r->seq;
+        }
+        if(r->type == JOURNAL_EVENT && r->seq > maxSeq) {
+            maxSeq = r->seq;
+        }
+        if(r->boot > maxBoot) {
+            maxBoot = r->boot;
+        }
+    }
+    next_seq = maxSeq + 1;
+    boot = maxBoot + 1;
+    persisted_ack = acked;
+
+    unacked_addr = find_unacked(first_slot());
+    fwd_addr = unacked_addr;
+}
+
+void Journal_Log(const RC522_Uid *card, uint8_t result, uint32_t dataHash) {
+    Journal_Record *r;
+
+    if(q_count >= JOURNAL_QUEUE) {
+        stats.dropped++;
+        return;
+    }
+    r = &queue[(q_tail + q_count) % JOURNAL_QUEUE];
+    memset(r, 0, sizeof(*r));
+    r->seq = next_seq++;
+    r->time = millis();
+    r->boot = boot;
+    r->type = JOURNAL_EVENT;
+    r->result = result;
+    r->uidSize = card->size;
+    memcpy(r->uid, card->uid, card->size);
+    r->dataHash = dataHash;
+    r->crc = rec_crc(r);
+    q_count++;
+    stats.logged++;
+}
+
+static void format_record(char *msg, const char *prefix, const Journal_Record *r) {
+    char *p = msg + sprintf(msg, "%s%u:%u:%u:", prefix, (unsigned int)r->seq,
+                            (unsigned int)r->boot, (unsigned int)r->time);
+    for(uint8_t i = 0; i < r->uidSize && i < sizeof(r->uid); i++) {
+        p += sprintf(p, "%02X", r->uid[i]);
+    }
+    sprintf(p, ":%u:%08X\r\n", r->result, (unsigned int)r->dataHash);
+}
+
+static void forward(void) {
+    char msg[96];
+    uint32_t now = millis();
+
+    // Sin ACK a tiempo: volver al primero sin confirmar
+    if(outstanding > 0 && deadline_expired(last_send + JOURNAL_RETRY_MS, now)) {
+        fwd_addr = unacked_addr;
+        outstanding = 0;
+    }
+
+    while(fwd_addr && outstanding < JOURNAL_WINDOW && USART1_TxFree() >= sizeof(msg)) {
+        const Journal_Record *r = rec_at(fwd_addr);
+
+        // Hueco antes del primero sin confirmar (segmento reciclado o
+        // ranura fallida): el gateway solo acepta en orden, se le avisa
+        if(fwd_addr == unacked_addr && r->seq > acked + 1) {
+            sprintf(msg, "LOG:SKIP:%u\r\n", (unsigned int)(r->seq - 1));
+            USART1_SendString(msg);
+        }
+        format_record(msg, "LOG:", r);
+        USART1_SendString(msg);
+
+        outstanding++;
+        last_send = now;
+        fwd_addr = next_slot(fwd_addr);
+        if(fwd_addr) {
+            fwd_addr = find_unacked(fwd_addr);
+        }
+    }
+}
+
+// =================== Consulta ===================
+
+static void query_enter(uint8_t s) {
+    query.seg = s;
+    if(seg_sealed(s)) {
+        // Primera entrada con la clave (bisección)
+        const uint32_t *idx = seg_index(s);
+        uint32_t lo = 0, hi = seg_header(s)->indexCount;
+        while(lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            if((idx[mid] >> 16) < query.key) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        query.pos = lo;
+    } else {
+        query.pos = segs[s].addr + SLOT;
+    }
+}
+
+static uint8_t query_match(const Journal_Record *r) {
+    return r->type == JOURNAL_EVENT && r->uidSize == query.size &&
+           memcmp(r->uid, query.uid, query.size) == 0 &&
+           r->seq >= query.since && rec_valid(r);
+}
+
+// Siguiente registro de la tarjeta en orden cronológico (NULL: fin)
+static const Journal_Record *query_next(void) {
+    for(;;) {
+        uint8_t s = query.seg;
+        if(seg_sealed(s)) {
+            const uint32_t *idx = seg_index(s);
+            uint32_t count = seg_header(s)->indexCount;
+            while(query.pos < count && (idx[query.pos] >> 16) == query.key) {
+                const Journal_Record *r = rec_at(segs[s].addr + SLOT + (idx[query.pos] & 0xFFFF) * SLOT);
+                query.pos++;
+                if(query_match(r)) {
+                    return r;
+                }
+            }
+        } else {
+            uint32_t end = (s == cur) ? write_addr : rec_end(s);
+            while(query.pos < end) {
+                const Journal_Record *r = rec_at(query.pos);
+                query.pos += SLOT;
+                if(query_match(r)) {
+                    return r;
+                }
+            }
+        }
+        if(s == cur) {
+            return NULL;
+        }
+        query_enter(cur);
+    }
+}
+
+static void query_start(const char *p) {
+    uint8_t n = 0;
+
+    query.active = 0;
+    query.found = 0;
+    while(hex_nibble(p[0]) >= 0 && hex_nibble(p[1]) >= 0 && n < sizeof(query.uid)) {
+        query.uid[n++] = (uint8_t)((hex_nibble(p[0]) << 4) | hex_nibble(p[1]));
+        p += 2;
+    }
+    if((n != 4 && n != 7 && n != 10) || (*p != ':' && *p != '\0')) {
+        query_end(":ERROR");
+        return;
+    }
+    query.size = n;
+    query.key = uid_key(query.uid, n);
+    query.since = (*p == ':') ? (uint32_t)strtoul(p + 1, NULL, 10) : 0;
+    query.active = 1;
+    query_enter(older_valid ? cur ^ 1 : cur);
+}
+
+static void query_send(void) {
+    char msg[96];
+
+    while(query.active && USART1_TxFree() >= sizeof(msg)) {
+        const Journal_Record *r = query_next();
+        if(r == NULL) {
+            query_end("");
+            return;
+        }
+        format_record(msg, "LOG:Q:", r);
+        USART1_SendString(msg);
+        query.found++;
+    }
+}
+
+// =================== Bucle ===================
+
+void Journal_Poll(uint8_t idle) {
+    if(full) {
+        if(!idle || Sync_Busy()) {
+            return;                         // El borrado espera al campo vacío
+        }
+        seal(cur);
+        recycle();
+        if(full) {
+            return;
+        }
+    }
+
+    // Lote de registros encolados
+    while(q_count > 0 && !full) {
+        program_record(&queue[q_tail]);
+        q_tail = (q_tail + 1) % JOURNAL_QUEUE;
+        q_count--;
+    }
+
+    // Confirmaciones del gateway, cada JOURNAL_ACK_PERSIST
+    if(!full && (acked - persisted_ack >= JOURNAL_ACK_PERSIST || ack_rewrite)) {
+        Journal_Record r;
+        memset(&r, 0, sizeof(r));
+        r.seq = acked;
+        r.time = millis();
+        r.boot = boot;
+        r.type = JOURNAL_ACK;
+        r.crc = rec_crc(&r);
+        program_record(&r);
+        persisted_ack = acked;
+        ack_rewrite = 0;
+    }
+
+    if(idle) {
+        forward();
+        query_send();
+    }
+}
+
+static void send_acked(void) {
+    char msg[32];
+    sprintf(msg, "LOG:ACKED:%u\r\n", (unsigned int)acked);
+    USART1_SendString(msg);
+}
+
+void Journal_Command(const char *p) {
+    char *end;
+    uint32_t seq;
+
+    if(strncmp(p, "QUERY:", 6) == 0) {
+        query_start(p + 6);
+        return;
+    }
+    if(strcmp(p, "STATUS") == 0) {
+        send_acked();
+        return;
+    }
+    if(strncmp(p, "ACK:", 4) != 0) {
+        return;
+    }
+    seq = (uint32_t)strtoul(p + 4, &end, 10);
+    if(end == p + 4 || seq <= acked) {
+        return;
+    }
+    if(seq >= next_seq) {
+        send_acked();                       // Diario reiniciado: el gateway se ajusta
+        return;
+    }
+
+    acked = seq;
+    unacked_addr = unacked_addr ? find_unacked(unacked_addr) : 0;
+    if(fwd_addr && rec_at(fwd_addr)->seq <= acked) {
+        fwd_addr = unacked_addr;
+    }
+    outstanding = 0;
+    last_send = millis();
+}
+
+uint32_t Journal_Hash(const uint8_t *data, uint8_t len) {
+    uint32_t h = 2166136261UL;
+    for(uint8_t i = 0; i < len; i++) {
+        h = (h ^ data[i]) * 16777619UL;
+    }
+    return h;
+}
+
+const Journal_Stats *Journal_GetStats(void) {
+    stats.lastSeq = next_seq - 1;
+    stats.ackedSeq = acked;
+    stats.pending = stats.lastSeq - acked;
+    return &stats;
+}
@@ -0,0 +1,115 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include "rc522.h"
+
+// ===== Diario de accesos en flash =====
+// Registro de eventos de tamaño fijo, solo por adición, en dos segmentos
+// en anillo (sector 4, 64 KB, y sector 5, 128 KB: ~6000 registros). Al
+// llenarse uno se borra el otro y se escribe allí: los dos sectores se
+// borran el mismo número de veces. Cada segmento empieza con una cabecera
+// con su generación; al arrancar se continúa tras el último registro.
+//
+// Journal_Log solo copia el registro a una cola en RAM; Journal_Poll lo
+// programa por lotes y reenvía al gateway los no confirmados:
+//
+//   LOG:<seq>:<arranque>:<ms>:<uid>:<resultado>:<hash>   (STM32 -> gateway)
+//   LOG:SKIP:<seq>      hasta seq no queda nada por enviar (STM32 -> gateway)
+//   LOG:ACK:<seq>                                        (gateway -> STM32)
+//   LOG:STATUS                      -> LOG:ACKED:<seq>   (gateway -> STM32)
+//
+// El ACK es acumulativo: el gateway solo confirma registros en orden
+// (seq == último + 1, o el seq de un SKIP) y ante un hueco repite su
+// último ACK; así un registro corrompido en la línea se reenvía en vez de
+// quedar cubierto por el ACK de uno posterior. Al arrancar el gateway pide
+// LOG:STATUS para saber desde dónde continuar. Un ACK por encima del
+// último seq (diario borrado) también se responde con LOG:ACKED.
+//
+// El ACK se guarda también en el diario (cada JOURNAL_ACK_PERSIST
+// confirmaciones): tras un reinicio se reenvían como mucho esas,
+// repetidas; el gateway descarta por seq.
+//
+// Al llenarse un segmento se sella: al final se escribe un índice con una
+// palabra por evento, (clave del UID << 16) | ranura, ordenado, y su
+// número de entradas en la cabecera. Una consulta busca la clave por
+// bisección en cada segmento sellado y solo lee los registros de esa
+// tarjeta; el segmento en escritura se recorre entero. Las coincidencias
+// se envían sin bloquear, según hay sitio en la cola de USART1:
+//
+//   LOG:QUERY:<uid>[:<desde seq>]                        (gateway -> STM32)
+//   LOG:Q:<seq>:<arranque>:<ms>:<uid>:<resultado>:<hash> (STM32 -> gateway)
+//   LOG:QEND:<n>[:ABORT]            (fin; ABORT si se borró el segmento)
+//   LOG:QEND:0:ERROR                (UID no válido)
+//
+// Reciclar un segmento borra un sector (1-2 s sin recibir por USART1): un
+// LOG:ACK perdido se recupera con el reenvío, y una consulta sin
+// LOG:QEND debe repetirla el gateway. No se recicla con una
+// sincronización de la lista blanca en curso.
+//
+// Sin RTC no hay fechas: "los últimos N días" los traduce el gateway a un
+// seq inicial con la hora a la que recibió cada registro.
+#define JOURNAL_SEG0_ADDR       0x08010000UL
+#define JOURNAL_SEG0_SIZE       0x10000UL
+#define JOURNAL_SEG1_ADDR       0x08020000UL
+#define JOURNAL_SEG1_SIZE       0x20000UL
+#define JOURNAL_MAGIC           0x324E524AUL    // "JRN2"
+#define JOURNAL_INDEX_MAGIC     0x58444E49UL    // "INDX": segmento sellado
+
+#define JOURNAL_QUEUE           16      // Registros pendientes de programar
+#define JOURNAL_WINDOW          4       // Registros enviados sin confirmar
+#define JOURNAL_RETRY_MS        3000    // Reenvío desde el primero sin ACK
+#define JOURNAL_ACK_PERSIST     16
+
+// Tipos de registro
+#define JOURNAL_EVENT           0x01
+#define JOURNAL_ACK             0x02
+
+// Resultado de un evento
+#define JOURNAL_GRANTED         0x01
+#define JOURNAL_DENIED          0x02
+#define JOURNAL_REVOKED         0x03
+
+// Registro de 32 bytes (8 palabras); el CRC detecta escrituras cortadas
+typedef struct {
+    uint32_t seq;            // Secuencia global (ACK: seq confirmada)
+    uint32_t time;           // ms desde el arranque (sin RTC)
+    uint16_t boot;           // Número de arranque
+    uint8_t type;
+    uint8_t result;
+    uint8_t uidSize;
+    uint8_t uid[10];
+    uint8_t reserved;
+    uint32_t dataHash;       // FNV-1a del bloque leído (0: sin lectura)
+    uint32_t crc;            // CRC-32 STM32 de las 7 primeras palabras
+} Journal_Record;
+
+typedef struct {
+    uint32_t logged;         // Eventos aceptados en la cola
+    uint32_t dropped;        // Cola llena
+    uint32_t lost;           // Sin confirmar al reciclar un segmento
+    uint32_t pending;        // Programados y aún sin ACK
+    uint32_t lastSeq;
+    uint32_t ackedSeq;
+} Journal_Stats;
+
+// ===== Funciones =====
+// Localiza el segmento actual y la posición de escritura (puede borrar
+// un segmento si no hay ninguno válido)
+extern void Journal_Init(void);
+
+// Encola un evento; nunca espera a la flash
+extern void Journal_Log(const RC522_Uid *card, uint8_t result, uint32_t dataHash);
+
+// Programación, borrado (solo con idle) y reenvío
+extern void Journal_Poll(uint8_t idle);
+
+// Línea "LOG:..." recibida del gateway (sin el prefijo): ACK, STATUS o QUERY
+extern void Journal_Command(const char *p);
+
+// FNV-1a de 32 bits (dataHash de los eventos)
+extern uint32_t Journal_Hash(const uint8_t *data, uint8_t len);
+
+extern const Journal_Stats *Journal_GetStats(void);
+
+#endif
@@ -0,0 +1,196 @@
+#include <string.h>
+#include "keys.h"
+#include "mifare.h"
+#include "rc522.h"
+
+typedef struct {
+    uint8_t authMode;
+    uint8_t flags;
+    uint8_t key[6];
+} key_slot_t;
+
+typedef struct {
+    uint8_t size;            // 0: entrada libre
+    uint8_t uid[10];
+    uint8_t sector;
+    uint8_t slot;
+    uint32_t stamp;          // Último uso (LRU)
+} key_cache_t;
+
+static key_slot_t slots[KEYS_MAX];
+static uint8_t slot_count = 0;
+
+// Ranuras candidatas de cada sector (bit n = ranura n)
+static uint8_t sector_mask[KEYS_MAX_SECTORS];
+
+static key_cache_t cache[KEYS_CACHE_SIZE];
+static uint32_t cache_clock = 0;
+
+static Keys_Diversify diversify = NULL;
+static Keys_Stats stats;
+
+static uint8_t same_uid(const key_cache_t *e, const RC522_Uid *card) {
+    return e->size == card->size && memcmp(e->uid, card->uid, card->size) == 0;
+}
+
+// Entrada exacta (UID, sector); si no la hay, en hint cualquier entrada
+// del mismo UID (las tarjetas suelen compartir clave entre sectores)
+static key_cache_t *cache_find(const RC522_Uid *card, uint8_t sector, key_cache_t **hint) {
+    *hint = NULL;
+    for(uint8_t i = 0; i < KEYS_CACHE_SIZE; i++) {
+        if(!same_uid(&cache[i], card)) {
+            continue;
+        }
+        if(cache[i].sector == sector) {
+            return &cache[i];
+        }
+        if(*hint == NULL || cache[i].stamp > (*hint)->stamp) {
+            *hint = &cache[i];
+        }
+    }
+    return NULL;
+}
+
+static void cache_store(const RC522_Uid *card, uint8_t sector, uint8_t slot) {
+    key_cache_t *hint;
+    key_cache_t *e = cache_find(card, sector, &hint);
+
+    // Libre o la usada hace más tiempo
+    if(e == NULL) {
+        e = &cache[0];
+        for(uint8_t i = 0; i < KEYS_CACHE_SIZE && e->size; i++) {
+            if(cache[i].size == 0 || cache[i].stamp < e->stamp) {
+                e = &cache[i];
+            }
+        }
+        e->size = card->size;
+        memcpy(e->uid, card->uid, card->size);
+        e->sector = sector;
+    }
+    e->slot = slot;
+    e->stamp = ++cache_clock;
+}
+
+static void slot_key(uint8_t slot, const RC522_Uid *card, uint8_t sector, uint8_t *key) {
+    if(slots[slot].flags & KEYS_DIVERSIFIED) {
+        diversify(card, sector, slots[slot].key, key);
+    } else {
+        memcpy(key, slots[slot].key, 6);
+    }
+}
+
+void Keys_Reset(void) {
+    slot_count = 0;
+    memset(sector_mask, 0, sizeof(sector_mask));
+    memset(cache, 0, sizeof(cache));
+    memset(&stats, 0, sizeof(stats));
+    cache_clock = 0;
+}
+
+void Keys_SetDiversifier(Keys_Diversify fn) {
+    diversify = fn;
+}
+
+int Keys_Add(uint8_t authMode, const uint8_t *key, uint8_t flags,
+             uint8_t firstSector, uint8_t lastSector) {
+    if(slot_count >= KEYS_MAX || firstSector > lastSector ||
+       lastSector >= KEYS_MAX_SECTORS) {
+        return -1;
+    }
+    slots[slot_count].authMode = authMode;
+    slots[slot_count].flags = flags;
+    memcpy(slots[slot_count].key, key, 6);
+    for(uint8_t s = firstSector; s <= lastSector; s++) {
+        sector_mask[s] |= (uint8_t)(1u << slot_count);
+    }
+    return slot_count++;
+}
+
+int Keys_AuthWith(const RC522_Uid *card, uint8_t blockAddr, uint8_t wantMode,
+                  uint8_t *authMode, uint8_t *key) {
+    uint8_t sector = MIFARE_BlockSector(blockAddr);
+    const uint8_t *uid = &card->uid[card->size - 4];
+    key_cache_t *hint;
+    key_cache_t *cached;
+    uint8_t mask;
+    uint8_t exact;
+    int first = -1;
+
+    stats.lookups++;
+    stats.lastAttempts = 0;
+    if(sector >= KEYS_MAX_SECTORS) {
+        stats.failures++;
+        return -1;
+    }
+    mask = sector_mask[sector];
+
+    // Sin derivación registrada las ranuras diversificadas no se prueban;
+    // con wantMode solo las del tipo pedido (A o B)
+    for(uint8_t s = 0; s < slot_count; s++) {
+        if(((slots[s].flags & KEYS_DIVERSIFIED) && diversify == NULL) ||
+           (wantMode != 0 && slots[s].authMode != wantMode)) {
+            mask &= (uint8_t)~(1u << s);
+        }
+    }
+
+    cached = cache_find(card, sector, &hint);
+    exact = (cached != NULL);
+    if(!exact) {
+        cached = hint;
+    }
+    if(cached != NULL && (mask & (1u << cached->slot))) {
+        first = cached->slot;
+    }
+
+    // Orden: ranura en caché y después la tabla en orden de alta
+    for(int n = -1; n < (int)slot_count; n++) {
+        int s = (n < 0) ? first : n;
+        if(s < 0 || !(mask & (1u << s)) || (n >= 0 && s == first)) {
+            continue;
+        }
+
+        // Tras un fallo la tarjeta está en IDLE
+        if(stats.lastAttempts > 0) {
+            RC522_StopCrypto1();
+            stats.reselects++;
+            if(RC522_SelectUid(card) != 0) {
+                break;
+            }
+        }
+
+        slot_key((uint8_t)s, card, sector, key);
+        stats.attempts++;
+        stats.lastAttempts++;
+        if(MIFARE_Auth(slots[s].authMode, blockAddr, key, (uint8_t *)uid) == 0) {
+            if(exact && s == first && stats.lastAttempts == 1) {
+                stats.hits++;
+            } else {
+                stats.misses++;
+            }
+            *authMode = slots[s].authMode;
+            cache_store(card, sector, (uint8_t)s);
+            return s;
+        }
+    }
+
+    stats.misses++;
+    stats.failures++;
+    return -1;
+}
+
+int Keys_Auth(const RC522_Uid *card, uint8_t blockAddr,
+              uint8_t *authMode, uint8_t *key) {
+    return Keys_AuthWith(card, blockAddr, 0, authMode, key);
+}
+
+void Keys_Forget(const RC522_Uid *card) {
+    for(uint8_t i = 0; i < KEYS_CACHE_SIZE; i++) {
+        if(same_uid(&cache[i], card)) {
+            cache[i].size = 0;
+        }
+    }
+}
+
+const Keys_Stats *Keys_GetStats(void) {
+    return &stats;
+}
@@ -0,0 +1,61 @@
+#ifndef KEYS_H
+#define KEYS_H
+
+#include <stdint.h>
+#include "rc522.h"
+
+// ===== Gestor de claves MIFARE Classic =====
+// Tabla de claves candidatas (A o B) con el rango de sectores en que se
+// prueban, y caché LRU (UID, sector) -> última ranura que autenticó.
+// Un MFAuthent fallido deja la tarjeta en IDLE y obliga a WUPA + SELECT
+// antes del siguiente intento: acertar a la primera es lo que cuenta.
+#ifndef KEYS_MAX
+#define KEYS_MAX            8
+#endif
+#if KEYS_MAX > 8
+#error "KEYS_MAX > 8: la máscara de candidatas por sector es de 8 bits"
+#endif
+#ifndef KEYS_CACHE_SIZE
+#define KEYS_CACHE_SIZE     16
+#endif
+#define KEYS_MAX_SECTORS    40
+
+// Flags de ranura
+#define KEYS_DIVERSIFIED    0x01    // key es la clave maestra: se deriva por UID
+
+// Derivación de claves diversificadas (esquema propio del despliegue)
+typedef void (*Keys_Diversify)(const RC522_Uid *card, uint8_t sector,
+                               const uint8_t *master, uint8_t *key);
+
+typedef struct {
+    uint32_t lookups;        // Llamadas a Keys_Auth
+    uint32_t hits;           // Clave en caché correcta al primer intento
+    uint32_t misses;         // Sin entrada en caché o clave en caché errónea
+    uint32_t attempts;       // MFAuthent enviados
+    uint32_t reselects;      // WUPA + SELECT tras un fallo
+    uint32_t failures;       // Ninguna candidata autenticó
+    uint8_t lastAttempts;    // MFAuthent de la última llamada
+} Keys_Stats;
+
+// ===== Funciones =====
+extern void Keys_Reset(void);
+extern void Keys_SetDiversifier(Keys_Diversify fn);
+
+// authMode PICC_AUTHENT1A / PICC_AUTHENT1B; devuelve la ranura o -1
+extern int Keys_Add(uint8_t authMode, const uint8_t *key, uint8_t flags,
+                    uint8_t firstSector, uint8_t lastSector);
+
+// Autenticar blockAddr de la tarjeta seleccionada: primero la ranura en
+// caché, luego el resto de candidatas del sector. Devuelve la ranura y
+// la clave usada (para reautenticar), o -1 con la tarjeta en IDLE
+extern int Keys_Auth(const RC522_Uid *card, uint8_t blockAddr,
+                     uint8_t *authMode, uint8_t *key);
+
+// Igual, solo con claves del tipo wantMode (PICC_AUTHENT1A/B; 0: cualquiera)
+extern int Keys_AuthWith(const RC522_Uid *card, uint8_t blockAddr, uint8_t wantMode,
+                         uint8_t *authMode, uint8_t *key);
+
+extern void Keys_Forget(const RC522_Uid *card);
+extern const Keys_Stats *Keys_GetStats(void);
+
+#endif
@@ -7,6 +7,14 @@
  * - usart.c/h: Funciones de comunicación UART
  * - mifare.c/h: Operaciones MIFARE y funciones auxiliares
  * - rc522.c/h: Interfaz de hardware RC522
+ * - timing.c/h: Retardos y reloj monotónico (DWT + SysTick)
+ * - presence.c/h: Seguimiento de tarjetas en el campo (CARD:REMOVED)
+ * - keys.c/h: Claves por sector y caché UID -> clave
+ * - access.c/h: Condiciones de acceso de los trailers y plan de autenticaciones
+ * - whitelist.c/h: Lista blanca de UIDs en flash (decisión local de acceso)
+ * - bloom.c/h: Filtro de Bloom de tarjetas revocadas en flash
+ * - sync.c/h, flash.c/h: Actualización incremental de la lista blanca por USART1
+ * - journal.c/h: Diario de accesos en flash con reenvío al gateway
  */
 
 #include <stm32f446xx.h>
@@ -17,6 +25,34 @@
 #include "usart.h"
 #include "mifare.h"
 #include "rc522.h"
+#include "timing.h"
+#include "presence.h"
+#include "keys.h"
+#include "access.h"
+#include "whitelist.h"
+#include "bloom.h"
+#include "sync.h"
+#include "journal.h"
+
+// Periodo del bucle de sondeo y de los sondeos de presencia (ms),
+// independiente de lo que tarde cada vuelta
+#define POLL_PERIOD_MS  50
+
+// Tarjetas por lote de inventario
+#define INVENTORY_MAX   8
+
+// 1: relectura del bloque escrito para verificarlo (misma sesión)
+#ifndef WRITE_VERIFY
+#define WRITE_VERIFY    1
+#endif
+
+// Tiempo de apertura de la puerta (PC13, activa a nivel bajo)
+#define DOOR_PULSE_MS   3000
+
+// 1: volcado completo de cada tarjeta nueva (un auth + 4 READ por sector)
+#ifndef CARD_DUMP
+#define CARD_DUMP       0
+#endif
 
 // =================== CONFIGURACIÓN DEL SISTEMA ===================
 
@@ -52,6 +88,7 @@ void SystemClock_Config(void) {
     
     // Habilitar relojes de GPIO y periféricos
     RCC->AHB1ENR |= RCC_AHB1ENR_GPIOAEN;
+    RCC->AHB1ENR |= RCC_AHB1ENR_GPIOCEN;    // PC13: cerradura
     RCC->APB2ENR |= RCC_APB2ENR_SPI1EN;
     RCC->APB1ENR |= RCC_APB1ENR_USART2EN;
     RCC->APB2ENR |= RCC_APB2ENR_USART1EN;
@@ -60,6 +97,333 @@ void SystemClock_Config(void) {
     (void)temp;
 }
 
+// =================== PROCESAR TARJETA ===================
+
+// Hash del bloque 4 de la tarjeta en curso para el diario (0: sin lectura)
+static uint32_t blockHash;
+
+// Se llama con el READ del bloque siguiente en curso (no toca el RC522)
+static void showBlock(uint8_t blockAddr, const uint8_t *data) {
+    char msg[48];
+    
+    sprintf(msg, "   Bloque %u:\r\n", blockAddr);
+    USART_SendString(msg);
+    printBlockDataFormatted((uint8_t *)data);
+    
+    // Trailer: condiciones de acceso del sector para esta sesión
+    uint8_t sector = MIFARE_BlockSector(blockAddr);
+    if(blockAddr == MIFARE_SectorFirstBlock(sector) + MIFARE_SectorBlockCount(sector) - 1) {
+        Access_Learn(blockAddr, data);
+    }
+    
+    // Enviar datos del bloque 4 a NodeMCU
+    if(blockAddr == 4) {
+        blockHash = Journal_Hash(data, 16);
+        char *p = msg + sprintf(msg, "DATA:");
+        for(uint8_t i = 0; i < 16; i++) {
+            p += sprintf(p, "%02X", data[i]);
+        }
+        strcpy(p, "\r\n");
+        USART1_SendString(msg);
+    }
+}
+
+// Imagen completa de un Ultralight/NTAG (static: la pila es de 1 KB)
+static uint8_t ulData[MIFARE_UL_MAX_PAGES * 4];
+
+// Ultralight/NTAG: tipo por GET_VERSION, lectura de toda la memoria con
+// FAST_READ y escritura pendiente en las páginas 4-7 (el equivalente al
+// bloque 4 de una Classic)
+static void processUltralight(uint8_t *pendingWrite) {
+    char msg[96];
+    MIFARE_ULInfo info;
+    uint32_t sessionStart = micros();
+    
+    USART_SendString("\n1. LEYENDO Ultralight/NTAG...\r\n");
+    if(MIFARE_UL_GetVersion(&info) != 0) {
+        USART_SendString("   Tarjeta perdida\r\n");
+        USART1_SendString("READ:FAIL\r\n");
+        return;
+    }
+    sprintf(msg, "   Tipo: %s, %u páginas\r\n", MIFARE_UL_TypeName(info.type), info.pages);
+    USART_SendString(msg);
+    
+    if(MIFARE_UL_ReadPages(&info, 0, info.pages - 1, ulData) == 0) {
+        const MIFARE_ReadStats *rs = MIFARE_GetReadStats();
+        sprintf(msg, "   %u páginas en %u tramas, %u us\r\n",
+                rs->blocks, rs->reads, (unsigned int)rs->micros);
+        USART_SendString(msg);
+        
+#if CARD_DUMP
+        for(uint8_t page = 0; page < info.pages; page++) {
+            sprintf(msg, "   Pág. %3u: ", page);
+            USART_SendString(msg);
+            USART_PrintHex(&ulData[page * 4], 4);
+            USART_SendString("\r\n");
+        }
+#endif
+        showBlock(MIFARE_UL_USER_PAGE, &ulData[MIFARE_UL_USER_PAGE * 4]);
+    } else {
+        USART_SendString("   FALLÓ\r\n");
+        USART1_SendString("READ:FAIL\r\n");
+    }
+    
+    // ===== ESCRIBIR páginas 4-7 (si está pendiente) =====
+    if (*pendingWrite >= '0' && *pendingWrite <= '2') {
+        uint8_t writeData[16];
+        uint8_t readBack[18];
+        int wr = 0;
+        
+        USART_SendString("\n2. ESCRIBIENDO páginas 4-7...\r\n");
+        prepareWriteData(*pendingWrite, writeData);
+        
+        for(uint8_t i = 0; i < 4 && wr == 0; i++) {
+            wr = MIFARE_UL_Write(MIFARE_UL_USER_PAGE + i, &writeData[i * 4]);
+        }
+        if(wr == 0 && WRITE_VERIFY) {
+            if(MIFARE_UL_Read(MIFARE_UL_USER_PAGE, readBack) != 0) {
+                wr = MIFARE_ERR;
+            } else if(memcmp(readBack, writeData, 16) != 0) {
+                wr = MIFARE_VERIFY_FAIL;
+            }
+        }
+        
+        if(wr == 0) {
+            USART_SendString("   ESCRITURA OK\r\n");
+            USART1_SendString("WRITE:OK\r\n");
+        } else {
+            USART_SendString(wr == MIFARE_VERIFY_FAIL ? "   VERIFICACIÓN FALLÓ\r\n"
+                                                      : "   ESCRITURA FALLÓ\r\n");
+            USART1_SendString("WRITE:FAIL\r\n");
+        }
+        
+        *pendingWrite = 0;
+    }
+    
+    sprintf(msg, "   Sesión: %u us\r\n", (unsigned int)(micros() - sessionStart));
+    USART_SendString(msg);
+}
+
+// Bloques 4-7 y datos a escribir (static: la pila es de 1 KB)
+static uint8_t sector1[4][16];
+static uint8_t blockWrite[16];
+
+// Lectura (y escritura pendiente) del bloque 4 de la tarjeta seleccionada.
+// La sesión Crypto1 queda abierta: el HLTA debe ir cifrado
+static void processCard(RC522_Uid *card, uint32_t cardNum, uint8_t *pendingWrite,
+                        uint8_t revoked) {
+    char msg[128];
+    
+    // Tráfico SPI de REQA/anticolisión/select de esta tarjeta
+    const RC522_Stats *st = RC522_GetStats();
+    
+    // Enviar UID a NodeMCU
+    sprintf(msg, "\r\n[%u] TARJETA DETECTADA\r\n", (unsigned int)cardNum);
+    USART_SendString(msg);
+    
+    sprintf(msg, "SPI: %u tramas (%u lect. en caché, %u escr. evitadas)\r\n",
+            (unsigned int)st->spiFrames, (unsigned int)st->shadowHits,
+            (unsigned int)st->writesSkipped);
+    USART_SendString(msg);
+    
+    MIFARE_Family family = MIFARE_Classify(card);
+    sprintf(msg, "Tipo: %s (ATQA %02X%02X, SAK %02X)\r\n", MIFARE_FamilyName(family),
+            card->atqa[1], card->atqa[0], card->sak);
+    USART_SendString(msg);
+    
+    sprintf(msg, "UID (%u bytes): ", card->size);
+    USART_SendString(msg);
+    USART_PrintHex(card->uid, card->size);
+    USART_SendString("\r\n");
+    
+    // UID:<2*size dígitos hex> (8, 14 o 20)
+    char *p = msg + sprintf(msg, "UID:");
+    for(uint8_t i = 0; i < card->size; i++) {
+        p += sprintf(p, "%02X", card->uid[i]);
+    }
+    strcpy(p, "\r\n");
+    USART1_SendString(msg);
+    
+    // Revocada: ni autenticación ni lectura
+    if(revoked) {
+        USART_SendString("   Tarjeta revocada\r\n");
+        return;
+    }
+    
+    // Estrategia de lectura según la familia
+    switch(family) {
+        case MIFARE_FAMILY_MINI:
+        case MIFARE_FAMILY_CLASSIC_1K:
+        case MIFARE_FAMILY_CLASSIC_4K:
+            break;                  // Sector 1 con Crypto1 (abajo)
+        
+        case MIFARE_FAMILY_ULTRALIGHT:
+            // Páginas de 4 bytes, sin Crypto1
+            processUltralight(pendingWrite);
+            return;
+        
+        default:
+            // Sin Crypto1 ni páginas: no se intenta autenticar (evita el
+            // timeout de MFAuthent). La escritura sigue pendiente
+            USART_SendString("   Tarjeta no soportada\r\n");
+            USART1_SendString("READ:UNSUPPORTED\r\n");
+            return;
+    }
+    
+    // ===== LEER Sector 1 (bloques 4-7) y ESCRIBIR bloque 4 =====
+    // Un solo plan: un auth (clave de la caché primero), cuatro READ
+    // encadenados (el trailer, bloque 7, fija qué clave puede escribir) y
+    // la escritura pendiente, con auth anidado solo si el trailer exige la
+    // otra clave. El bloque 4 va al NodeMCU desde showBlock
+    Access_Reset();
+    USART_SendString("\n1. LEYENDO sector 1...\r\n");
+    uint32_t sessionStart = micros();
+    uint32_t auths = Access_GetStats()->auths;
+    uint8_t writeLevel = (*pendingWrite >= '0' && *pendingWrite <= '2') ? *pendingWrite : 0;
+    Access_Op ops[5];
+    uint8_t nops = 0;
+    
+    for(uint8_t b = 4; b < 8; b++) {
+        ops[nops].block = b;
+        ops[nops].write = ACCESS_READ;
+        ops[nops].data = sector1[b - 4];
+        nops++;
+    }
+    if(writeLevel) {
+        prepareWriteData(writeLevel, blockWrite);
+        ops[nops].block = 4;
+        ops[nops].write = ACCESS_WRITE;
+        ops[nops].data = blockWrite;
+        nops++;
+    }
+    
+    Access_Run(card, ops, nops, WRITE_VERIFY, showBlock);
+    
+    // Access_Run reordena ops: la primera lectura fallida decide el mensaje
+    int readResult = 0, writeResult = 0;
+    for(uint8_t i = 0; i < nops; i++) {
+        if(ops[i].write) {
+            writeResult = ops[i].result;
+        } else if(readResult == 0) {
+            readResult = ops[i].result;
+        }
+    }
+    
+    sprintf(msg, "   Auth: %u, clave: %u intento(s)\r\n",
+            (unsigned int)(Access_GetStats()->auths - auths), Keys_GetStats()->lastAttempts);
+    USART_SendString(msg);
+    
+    if(readResult == ACCESS_AUTH_FAIL) {
+        USART_SendString("   Autenticación FALLÓ\r\n");
+        USART1_SendString("AUTH:FAIL\r\n");
+    } else if(readResult != 0) {
+        USART_SendString("   FALLÓ\r\n");
+        USART1_SendString("READ:FAIL\r\n");
+    }
+    
+    const MIFARE_ReadStats *rs = MIFARE_GetReadStats();
+    sprintf(msg, "   %u bloques, %u READ en %u us\r\n",
+            rs->blocks, rs->reads, (unsigned int)rs->micros);
+    USART_SendString(msg);
+    
+    if(writeLevel) {
+        USART_SendString("\n2. ESCRIBIENDO en bloque 4...\r\n");
+        USART_SendString("   Datos a escribir: ");
+        printBlockDataFormatted(blockWrite);
+        
+        if(writeResult == ACCESS_DENIED) {
+            USART_SendString("   El trailer no permite escribir el bloque 4\r\n");
+            USART1_SendString("WRITE:FAIL\r\n");
+        } else if(writeResult == ACCESS_AUTH_FAIL) {
+            USART_SendString("   Autenticación FALLÓ\r\n");
+            USART1_SendString("AUTH:FAIL\r\n");
+        } else if(writeResult == 0) {
+            USART_SendString(WRITE_VERIFY ? "   ESCRITURA OK (verificada)\r\n"
+                                          : "   ESCRITURA OK\r\n");
+            USART1_SendString("WRITE:OK\r\n");
+        } else {
+            USART_SendString(writeResult == MIFARE_VERIFY_FAIL ? "   VERIFICACIÓN FALLÓ\r\n"
+                                                               : "   ESCRITURA FALLÓ\r\n");
+            USART1_SendString("WRITE:FAIL\r\n");
+        }
+        *pendingWrite = 0;
+    }
+    
+#if CARD_DUMP
+    // ===== Volcado completo =====
+    // Mini: 5 sectores; 1K: 16; 4K: 40
+    uint8_t sectors = MIFARE_SectorCount(family);
+    uint8_t authMode;
+    uint8_t key[6];
+    uint8_t *uid = &card->uid[card->size - 4];     // Crypto1: 4 últimos bytes
+    uint32_t dumpAuths = 0, dumpReads = 0, dumpBlocks = 0;
+    uint32_t dumpStart = micros();
+    
+    USART_SendString("\nVOLCADO:\r\n");
+    for(uint8_t sector = 0; sector < sectors; sector++) {
+        int ok = Keys_Auth(card, MIFARE_SectorFirstBlock(sector), &authMode, key) >= 0 &&
+                 MIFARE_ReadSector(sector, authMode, NULL, uid, NULL, showBlock) == 0;
+        dumpAuths += Keys_GetStats()->lastAttempts;
+        if(!ok) {
+            sprintf(msg, "   Sector %u: FALLÓ\r\n", sector);
+            USART_SendString(msg);
+            
+            // La autenticación fallida deja la tarjeta en IDLE
+            RC522_StopCrypto1();
+            RC522_Uid again;
+            if(RC522_ReselectCard(&again) != 0) {
+                break;
+            }
+        }
+        rs = MIFARE_GetReadStats();
+        dumpReads += rs->reads;
+        dumpBlocks += rs->blocks;
+    }
+    
+    sprintf(msg, "Volcado: %u sectores, %u bloques, %u auth, %u READ en %u ms\r\n",
+            sectors, (unsigned int)dumpBlocks, (unsigned int)dumpAuths,
+            (unsigned int)dumpReads, (unsigned int)((micros() - dumpStart) / 1000));
+    USART_SendString(msg);
+#endif
+    
+    sprintf(msg, "   Sesión: %u us\r\n", (unsigned int)(micros() - sessionStart));
+    USART_SendString(msg);
+}
+
+// =================== PUERTA ===================
+
+// PC13 queda en alto tras confGPIO: nivel bajo = apertura
+static uint8_t doorOpen = 0;
+static uint32_t doorClose;
+
+static void doorGrant(void) {
+    GPIOC->BSRR = (1u << (13 + 16));
+    doorOpen = 1;
+    doorClose = millis() + DOOR_PULSE_MS;
+}
+
+static void doorPoll(void) {
+    if(doorOpen && deadline_expired(doorClose, millis())) {
+        GPIOC->BSRR = (1u << 13);
+        doorOpen = 0;
+    }
+}
+
+// =================== CLAVES ===================
+
+// Candidatas por sector en orden de prueba (la caché UID -> clave va
+// delante). Claves del despliegue aquí; las diversificadas por UID se
+// registran con KEYS_DIVERSIFIED y Keys_SetDiversifier
+static const struct {
+    uint8_t authMode;
+    uint8_t key[6];
+    uint8_t firstSector;
+    uint8_t lastSector;
+} key_table[] = {
+    { PICC_AUTHENT1A, {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}, 0, KEYS_MAX_SECTORS - 1 },
+    { PICC_AUTHENT1B, {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}, 0, KEYS_MAX_SECTORS - 1 },
+};
+
 // =================== FUNCIÓN MAIN ===================
 
 int main(void) {
@@ -67,9 +431,12 @@ int main(void) {
     
     // ===== Inicializar sistema =====
     SystemClock_Config();
+    Timing_Init();
     confGPIO();
     confUSART();
     confSPI();
+    confDMA();
+    confEXTI();
     
     // ===== Salida de debug =====
     USART_SendString("\r\n\r\n");
@@ -96,24 +463,81 @@ int main(void) {
     RC522_Init();
     RC522_SetBitMask(TxControlReg, 0x03);
     
+    // Reloj SPI más rápido que permita el cableado
+    uint8_t br = RC522_AutotuneSPI();
+    if(br != 0xFF) {
+        sprintf(msg, "SPI1: /%u (%u kHz)\r\n", 2u << br, 90000u >> (br + 1));
+    } else {
+        sprintf(msg, "SPI1: prueba de enlace FALLÓ, se mantiene /32\r\n");
+    }
+    USART_SendString(msg);
+    
+    // Coste de un acceso de registro en tramas de 8 y 16 bits
+    uint32_t cyc8, cyc16;
+    RC522_BenchRegAccess(&cyc8, &cyc16);
+    sprintf(msg, "Acceso registro: %u ciclos (8 bits), %u ciclos (16 bits)\r\n",
+            (unsigned int)cyc8, (unsigned int)cyc16);
+    USART_SendString(msg);
+    
+    // Lista blanca en flash (CRC de toda la imagen, una vez)
+    if(Whitelist_Init() == 0) {
+        sprintf(msg, "Lista blanca: %u UIDs (versión %u)\r\n",
+                (unsigned int)Whitelist_Count(), (unsigned int)Whitelist_Version());
+    } else {
+        sprintf(msg, "Lista blanca: imagen inválida, se deniega todo\r\n");
+    }
+    USART_SendString(msg);
+    Sync_Init();
+    
+    Journal_Init();
+    const Journal_Stats *js = Journal_GetStats();
+    sprintf(msg, "Diario: último evento %u, %u sin confirmar\r\n",
+            (unsigned int)js->lastSeq, (unsigned int)js->pending);
+    USART_SendString(msg);
+    
+    if(Bloom_Init() == 0) {
+        sprintf(msg, "Revocadas: %u UIDs en filtro de Bloom (versión %u)\r\n",
+                (unsigned int)Bloom_Count(), (unsigned int)Bloom_Version());
+    } else {
+        sprintf(msg, "Revocadas: sin filtro\r\n");
+    }
+    USART_SendString(msg);
+    
     USART_SendString("RC522 Inicializado\r\n");
     USART_SendString("=========================================\r\n");
     USART_SendString("Acerca una tarjeta...\r\n\r\n");
     
     // ===== Configuración MIFARE =====
-    uint8_t atqa[2], atqaLen, uid[10], uidLen;
-    uint8_t keyA[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    Keys_Reset();
+    for(uint8_t i = 0; i < sizeof(key_table) / sizeof(key_table[0]); i++) {
+        Keys_Add(key_table[i].authMode, key_table[i].key, 0,
+                 key_table[i].firstSector, key_table[i].lastSector);
+    }
+    
+    uint8_t atqa[2], atqaLen;
+    RC522_Uid card;
+    RC522_Uid batch[INVENTORY_MAX];
     uint32_t cardCount = 0;
     uint8_t pendingWrite = 0;
+    uint32_t idleReported = 0;
+    uint32_t nextPoll = millis();
     
     // ===== Bucle principal =====
     while(1) {
+        doorPoll();
+        
         // Verificar comandos de NodeMCU (0, 1, o 2)
         uint8_t levelCode = 0;
         uint32_t uart_wait_count = 0;
         
-        while(USART1_Available() && uart_wait_count < 100) {
+        while(USART1_Available() && uart_wait_count < USART1_RX_SIZE) {
             levelCode = USART1_Receivechar();
+            uart_wait_count++;
+            
+            // Líneas SYNC:... (actualización de la lista blanca)
+            if(Sync_Feed(levelCode)) {
+                continue;
+            }
             
             // Debug: mostrar carácter recibido
             sprintf(msg, "[RX: 0x%02X='%c'] ", levelCode, 
@@ -131,86 +555,139 @@ int main(void) {
                 pendingWrite = levelCode;
                 break;
             }
-            uart_wait_count++;
         }
         
-        // Detectar tarjeta
-        if(RC522_RequestA(atqa, &atqaLen) == 0) {
-            if(RC522_AnticollCL1(uid, &uidLen) == 0) {
-                if(RC522_Select(uid) == 0) {
-                    cardCount++;
-                    
-                    // Enviar UID a NodeMCU
-                    sprintf(msg, "\r\n[%u] TARJETA DETECTADA\r\n", (unsigned int)cardCount);
-                    USART_SendString(msg);
-                    
-                    USART_SendString("UID: ");
-                    USART_PrintHex(uid, 4);
-                    USART_SendString("\r\n");
-                    
-                    sprintf(msg, "UID:%02X%02X%02X%02X\r\n", uid[0], uid[1], uid[2], uid[3]);
-                    USART1_SendString(msg);
-                    
-                    // ===== LEER Bloque 4 =====
-                    USART_SendString("\n1. LEYENDO bloque 4...\r\n");
-                    uint8_t blockData[18];
-                    
-                    if(MIFARE_Auth(PICC_AUTHENT1A, 4, keyA, uid) == 0) {
-                        if(MIFARE_Read(4, blockData) == 0) {
-                            printBlockDataFormatted(blockData);
-                            
-                            // Enviar datos del bloque a NodeMCU
-                            USART1_SendString("DATA:");
-                            for(uint8_t i = 0; i < 16; i++) {
-                                sprintf(msg, "%02X", blockData[i]);
-                                USART1_SendString(msg);
-                            }
-                            USART1_SendString("\r\n");
-                        } else {
-                            USART_SendString("   FALLÓ\r\n");
-                            USART1_SendString("READ:FAIL\r\n");
-                        }
-                    } else {
-                        USART_SendString("   Autenticación FALLÓ\r\n");
-                        USART1_SendString("AUTH:FAIL\r\n");
-                    }
-                    
-                    delay_ms(50);
-                    
-                    // ===== ESCRIBIR Bloque 4 (si está pendiente) =====
-                    if (pendingWrite >= '0' && pendingWrite <= '2') {
-                        USART_SendString("\n2. ESCRIBIENDO en bloque 4...\r\n");
-                        uint8_t writeData[16];
-                        prepareWriteData(pendingWrite, writeData);
-                        
-                        USART_SendString("   Datos a escribir: ");
-                        printBlockDataFormatted(writeData);
-                        
-                        if(MIFARE_Auth(PICC_AUTHENT1A, 4, keyA, uid) == 0) {
-                            if(MIFARE_Write(4, writeData) == 0) {
-                                USART_SendString("   ESCRITURA OK\r\n");
-                                USART1_SendString("WRITE:OK\r\n");
-                            } else {
-                                USART_SendString("   ESCRITURA FALLÓ\r\n");
-                                USART1_SendString("WRITE:FAIL\r\n");
-                            }
-                        } else {
-                            USART_SendString("   Autenticación FALLÓ\r\n");
-                            USART1_SendString("AUTH:FAIL\r\n");
-                        }
-                        
-                        pendingWrite = 0;
-                    }
-                    
-                    // Detener sesión criptográfica
-                    RC522_StopCrypto1();
-                    USART_SendString("\r\n=== COMPLETADO ===\r\n");
-                    delay_ms(3000);
+        // Presencia: las tarjetas ya procesadas siguen en HALT y se
+        // sondean con WUPA + SELECT de su UID. Al retirarse se avisa al
+        // NodeMCU y la detección queda lista para la siguiente
+        uint8_t probed = Presence_Count();
+        if(probed > 0) {
+            RC522_Uid removed[PRESENCE_MAX];
+            uint8_t nRemoved = Presence_Probe(removed, PRESENCE_MAX);
+            
+            for(uint8_t i = 0; i < nRemoved; i++) {
+                char *p = msg + sprintf(msg, "CARD:REMOVED:");
+                for(uint8_t j = 0; j < removed[i].size; j++) {
+                    p += sprintf(p, "%02X", removed[i].uid[j]);
                 }
+                strcpy(p, "\r\n");
+                USART1_SendString(msg);
+                USART_SendString("\r\n[Presencia] ");
+                USART_SendString(msg);
             }
         }
         
-        delay_ms(300);
+        // Inventario de tarjetas nuevas: cada una se procesa una sola vez y
+        // se pone en HALT, así el siguiente REQA solo lo contestan las que
+        // faltan. El lote termina cuando nadie responde
+        uint8_t batchSize = 0;
+        uint8_t retry = (probed > 0);
+        uint32_t batchStart = micros();
+        
+        for(uint8_t tries = 0; tries < 2 * INVENTORY_MAX && batchSize < INVENTORY_MAX; tries++) {
+            RC522_ResetStats();
+            if(RC522_RequestA(atqa, &atqaLen) != 0 || RC522_SelectCard(&card) != 0) {
+                // Las tarjetas que despertó el WUPA del sondeo siguen en
+                // READY y descartan el primer REQA: repetirlo una vez
+                if(!retry) {
+                    break;
+                }
+                retry = 0;
+                continue;
+            }
+            
+            // Tarjeta en seguimiento que volvió a IDLE (p. ej. un corte
+            // breve de campo): no se procesa otra vez
+            if(Presence_Seen(&card)) {
+                RC522_HaltA();
+                continue;
+            }
+            
+            // Decisión local antes de cualquier tráfico UART: la puerta
+            // se abre en microsegundos tras el SELECT
+            // La revocación manda sobre la lista blanca
+            uint32_t decideStart = micros();
+            uint8_t revoked = Bloom_Revoked(&card);
+            uint8_t granted = !revoked && Whitelist_Contains(&card);
+            if(granted) {
+                doorGrant();
+            }
+            uint32_t decideUs = micros() - decideStart;
+            
+            batch[batchSize++] = card;
+            cardCount++;
+            blockHash = 0;
+            processCard(&card, cardCount, &pendingWrite, revoked);
+            
+            // Diario: solo se encola, la flash se programa al final de la vuelta
+            Journal_Log(&card, granted ? JOURNAL_GRANTED :
+                               revoked ? JOURNAL_REVOKED : JOURNAL_DENIED, blockHash);
+            
+            sprintf(msg, "   Acceso %s (%u us)\r\n",
+                    granted ? "CONCEDIDO" : revoked ? "DENEGADO (revocada)" : "DENEGADO",
+                    (unsigned int)decideUs);
+            USART_SendString(msg);
+            USART1_SendString(granted ? "ACCESS:GRANTED\r\n" :
+                              revoked ? "ACCESS:REVOKED\r\n" : "ACCESS:DENIED\r\n");
+            
+            // HLTA con Crypto1 activo (cifrado), después cerrar la sesión
+            RC522_HaltA();
+            RC522_StopCrypto1();
+            
+            if(Presence_Add(&card) != 0) {
+                USART_SendString("[Presencia] tabla llena\r\n");
+            }
+        }
+        
+        if(batchSize > 0) {
+            uint32_t elapsed = micros() - batchStart;
+            
+            sprintf(msg, "\r\n=== LOTE: %u tarjeta(s) en %u ms (%u tarjetas/s) ===\r\n",
+                    batchSize, (unsigned int)(elapsed / 1000),
+                    (unsigned int)((uint64_t)batchSize * 1000000UL / (elapsed ? elapsed : 1)));
+            USART_SendString(msg);
+            for(uint8_t i = 0; i < batchSize; i++) {
+                USART_SendString("   ");
+                USART_PrintHex(batch[i].uid, batch[i].size);
+                USART_SendString("\r\n");
+            }
+            
+            const Keys_Stats *ks = Keys_GetStats();
+            sprintf(msg, "Claves: %u aciertos de caché, %u fallos, %u auth, %u reselect\r\n",
+                    (unsigned int)ks->hits, (unsigned int)ks->misses,
+                    (unsigned int)ks->attempts, (unsigned int)ks->reselects);
+            USART_SendString(msg);
+        }
+        
+        // Cada 100 sondeos vacíos, latencia del camino sin tarjeta (180 MHz)
+        const RC522_PollStats *ps = RC522_GetPollStats();
+        if(ps->noCardPolls >= idleReported + 100) {
+            idleReported = ps->noCardPolls;
+            
+            // Supervisión del enlace SPI (baja la velocidad si hay errores)
+            RC522_LinkCheck();
+            sprintf(msg, "[Sondeo] sin tarjeta: %u us (máx %u us), %u tramas SPI\r\n",
+                    (unsigned int)(ps->lastCycles / TIMING_CYCLES_PER_US),
+                    (unsigned int)(ps->maxCycles / TIMING_CYCLES_PER_US),
+                    (unsigned int)ps->lastSpiFrames);
+            USART_SendString(msg);
+        }
+        
+        // Actualización de la lista blanca en segundo plano (el borrado
+        // de un banco solo con el campo vacío)
+        // y del diario (lote de registros, reciclado y reenvío)
+        uint8_t idle = (Presence_Count() == 0 && batchSize == 0);
+        Sync_Poll(idle);
+        Journal_Poll(idle);
+        
+        // Siguiente sondeo en un instante fijo; dormir hasta entonces
+        nextPoll += POLL_PERIOD_MS;
+        if(deadline_expired(nextPoll, millis())) {
+            nextPoll = millis();        // Vuelta larga (tarjeta): no recuperar
+        }
+        while(!deadline_expired(nextPoll, millis())) {
+            __WFI();
+        }
     }
     
     return 0;
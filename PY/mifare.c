@@ -1,6 +1,7 @@
 #include <stm32f446xx.h>
 #include "mifare.h"
 #include "usart.h"
+#include "timing.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -35,46 +36,139 @@ void printBlockDataFormatted(uint8_t *blockData) {
     USART_SendString("\r\n");
 }
 
+// =================== Clasificación ===================
+
+// SAK exactos primero: 0x28/0x38 tienen el bit ISO 14443-4 pero también
+// emulan Classic, que es el camino más barato
+static const struct {
+    uint8_t sak;
+    MIFARE_Family family;
+} sak_table[] = {
+    { 0x09, MIFARE_FAMILY_MINI },
+    { 0x08, MIFARE_FAMILY_CLASSIC_1K },
+    { 0x88, MIFARE_FAMILY_CLASSIC_1K },
+    { 0x28, MIFARE_FAMILY_CLASSIC_1K },
+    { 0x18, MIFARE_FAMILY_CLASSIC_4K },
+    { 0x38, MIFARE_FAMILY_CLASSIC_4K },
+    { 0x00, MIFARE_FAMILY_ULTRALIGHT },
+    { 0x10, MIFARE_FAMILY_PLUS_SL2 },
+    { 0x11, MIFARE_FAMILY_PLUS_SL2 },
+};
+
+MIFARE_Family MIFARE_Classify(const RC522_Uid *card) {
+    for(uint8_t i = 0; i < sizeof(sak_table) / sizeof(sak_table[0]); i++) {
+        if(card->sak == sak_table[i].sak) {
+            // Ultralight/NTAG: siempre UID de 7 bytes (ATQA 0x0044, bits
+            // de tamaño de UID = doble). Otro ATQA con SAK 0x00 no es NXP
+            if(sak_table[i].family == MIFARE_FAMILY_ULTRALIGHT &&
+               ((card->atqa[0] & 0xC0) != 0x40 || card->size != 7)) {
+                return MIFARE_FAMILY_UNKNOWN;
+            }
+            return sak_table[i].family;
+        }
+    }
+    if(card->sak & 0x20) {
+        return MIFARE_FAMILY_ISO14443_4;
+    }
+    return MIFARE_FAMILY_UNKNOWN;
+}
+
+const char *MIFARE_FamilyName(MIFARE_Family family) {
+    switch(family) {
+        case MIFARE_FAMILY_MINI:        return "MIFARE Mini";
+        case MIFARE_FAMILY_CLASSIC_1K:  return "MIFARE Classic 1K";
+        case MIFARE_FAMILY_CLASSIC_4K:  return "MIFARE Classic 4K";
+        case MIFARE_FAMILY_ULTRALIGHT:  return "Ultralight/NTAG";
+        case MIFARE_FAMILY_PLUS_SL2:    return "MIFARE Plus SL2";
+        case MIFARE_FAMILY_ISO14443_4:  return "ISO 14443-4";
+        default:                        return "desconocida";
+    }
+}
+
+uint8_t MIFARE_SectorCount(MIFARE_Family family) {
+    switch(family) {
+        case MIFARE_FAMILY_MINI:        return MIFARE_MINI_SECTORS;
+        case MIFARE_FAMILY_CLASSIC_1K:  return MIFARE_1K_SECTORS;
+        case MIFARE_FAMILY_CLASSIC_4K:  return MIFARE_4K_SECTORS;
+        default:                        return 0;
+    }
+}
+
 // =================== Operaciones MIFARE ===================
 
+// Respuesta de READ: 16 datos + CRC_A (software) o 16 datos ya
+// verificados por el RC522 (offload)
+static int mifare_check_read(const uint8_t *data, uint8_t backLen) {
+    uint8_t crc[2];
+    
+    if(RC522_CRCOffload()) {
+        return (backLen == 16) ? 0 : -1;
+    }
+    if(backLen != 18) {
+        return -1;
+    }
+    RC522_CalculateCRC((uint8_t *)data, 16, crc);
+    return (crc[0] == data[16] && crc[1] == data[17]) ? 0 : -1;
+}
+
 /**
- * Leer bloque - usando RC522_ToCard como la referencia
+ * Leer bloque - recvData debe tener 18 bytes (16 datos + CRC)
  */
 int MIFARE_Read(uint8_t blockAddr, uint8_t *recvData) {
     uint8_t status;
-    uint16_t unLen;
+    uint8_t len;
+    uint8_t backLen = 18;
 
-    recvData[0] = 0x30;  // Comando READ
+    recvData[0] = MIFARE_CMD_READ;
     recvData[1] = blockAddr;
-    RC522_CalculateCRC(recvData, 2, &recvData[2]);
+    len = RC522_AppendCRC(recvData, 2);
     
-    status = RC522_ToCard(PCD_Transceive, recvData, 4, recvData, &unLen);
+    status = RC522_Execute(RC522_CMD_READ, recvData, len, recvData, &backLen, NULL);
 
-    if ((status != MI_OK) || (unLen != 0x90)) {  // 0x90 = 144 bits = 18 bytes
+    if (status != MI_OK) {
         return -1;
     }
+    
+    // Software: 18 bytes = 16 datos + 2 CRC
+    // Offload: 16 bytes, el RC522 ya verificó y quitó el CRC
+    return mifare_check_read(recvData, backLen);
+}
 
-    return 0;
+// ACK/NAK de 4 bits (sin CRC) en el nibble bajo del único byte recibido
+static int mifare_check_ack(const uint8_t *ack, uint8_t ackLen) {
+    if(ackLen != 1) {
+        return MIFARE_ERR;
+    }
+    return ((ack[0] & 0x0F) == MIFARE_ACK) ? 0 : MIFARE_NAK;
 }
 
 /**
- * Escribir bloque - usando RC522_ToCard como la referencia
+ * Escribir bloque - dos tramas WRITE: comando y 16 bytes de datos.
+ * Devuelve 0, MIFARE_NAK si la tarjeta rechaza alguna trama o MIFARE_ERR
  */
 int MIFARE_Write(uint8_t blockAddr, uint8_t *writeData) {
-    uint8_t status;
-    uint16_t recvBits;
+    int status;
+    uint8_t ack[2];
+    uint8_t ackLen;
     uint8_t i;
+    uint8_t len;
     uint8_t buff[18];
 
     // Paso 1: Enviar comando de escritura
-    buff[0] = 0xA0;  // Comando WRITE
+    // El ACK/NAK es de 4 bits y no lleva CRC: solo CRC en transmisión
+    buff[0] = MIFARE_CMD_WRITE;
     buff[1] = blockAddr;
-    RC522_CalculateCRC(buff, 2, &buff[2]);
+    len = RC522_AppendCRC(buff, 2);
     
-    status = RC522_ToCard(PCD_Transceive, buff, 4, buff, &recvBits);
+    ackLen = sizeof(ack);
+    status = RC522_Execute(RC522_CMD_WRITE, buff, len, ack, &ackLen, NULL);
 
     if (status != MI_OK) {
-        return -1;
+        return MIFARE_ERR;
+    }
+    status = mifare_check_ack(ack, ackLen);
+    if (status != 0) {
+        return status;
     }
 
     // Paso 2: Enviar datos
@@ -82,23 +176,23 @@ int MIFARE_Write(uint8_t blockAddr, uint8_t *writeData) {
         for (i = 0; i < 16; i++) {
             buff[i] = writeData[i];
         }
-        RC522_CalculateCRC(buff, 16, &buff[16]);
-        status = RC522_ToCard(PCD_Transceive, buff, 18, buff, &recvBits);
+        len = RC522_AppendCRC(buff, 16);
+        ackLen = sizeof(ack);
+        status = RC522_Execute(RC522_CMD_WRITE, buff, len, ack, &ackLen, NULL);
 
         if (status != MI_OK) {
-            return -1;
+            return MIFARE_ERR;
         }
     }
 
-    return 0;
+    return mifare_check_ack(ack, ackLen);
 }
 
 /**
- * Autenticación - usando RC522_ToCard como la referencia
+ * Autenticación - MFAuthent con clave de 6 bytes y UID de 4 bytes
  */
 int MIFARE_Auth(uint8_t authMode, uint8_t blockAddr, uint8_t *key, uint8_t *uid) {
     uint8_t status;
-    uint16_t recvBits;
     uint8_t i;
     uint8_t buff[12];
 
@@ -112,7 +206,7 @@ int MIFARE_Auth(uint8_t authMode, uint8_t blockAddr, uint8_t *key, uint8_t *uid)
         buff[i + 8] = uid[i];
     }
 
-    status = RC522_ToCard(PCD_AUTHENT, buff, 12, buff, &recvBits);
+    status = RC522_Execute(RC522_CMD_AUTH, buff, 12, NULL, NULL, NULL);
 
     if ((status != MI_OK) || (!(RC522_ReadReg(Status2Reg) & 0x08))) {
         return -1;
@@ -120,3 +214,343 @@ int MIFARE_Auth(uint8_t authMode, uint8_t blockAddr, uint8_t *key, uint8_t *uid)
 
     return 0;
 }
+
+// =================== Lectura por sectores ===================
+
+static MIFARE_ReadStats read_stats;
+
+uint8_t MIFARE_SectorFirstBlock(uint8_t sector) {
+    return (sector < 32) ? (uint8_t)(sector * 4) : (uint8_t)(128 + (sector - 32) * 16);
+}
+
+uint8_t MIFARE_SectorBlockCount(uint8_t sector) {
+    return (sector < 32) ? 4 : 16;
+}
+
+uint8_t MIFARE_BlockSector(uint8_t blockAddr) {
+    return (blockAddr < 128) ? (uint8_t)(blockAddr / 4) : (uint8_t)(32 + (blockAddr - 128) / 16);
+}
+
+/**
+ * Leer count bloques desde first con una sola autenticación por sector.
+ * Tubería: se lanza el READ del bloque n y, mientras la tarjeta responde,
+ * se entrega el bloque n-1 al handler.
+ */
+int MIFARE_ReadBlocks(uint8_t first, uint8_t count, uint8_t authMode,
+                      uint8_t *key, uint8_t *uid, uint8_t *data,
+                      MIFARE_BlockHandler handler) {
+    uint8_t frame[4];
+    uint8_t buf[2][18];            // Bloque recibido / bloque en el handler
+    uint8_t cur = 0;
+    uint8_t havePrev = 0;
+    uint8_t backLen;
+    uint8_t len;
+    uint32_t start = micros();
+    int result = 0;
+    
+    memset(&read_stats, 0, sizeof(read_stats));
+    
+    for(uint8_t i = 0; i < count; i++) {
+        uint8_t block = first + i;
+        
+        // Nueva sesión Crypto1 al entrar en un sector
+        if(i == 0 || block == MIFARE_SectorFirstBlock(MIFARE_BlockSector(block))) {
+            if(havePrev && handler) {
+                handler(block - 1, buf[cur ^ 1]);
+                havePrev = 0;
+            }
+            // key NULL: el primer sector ya está autenticado (Keys_Auth)
+            if(key == NULL) {
+                if(i != 0) {
+                    result = -1;
+                    break;
+                }
+            } else {
+                read_stats.auths++;
+                if(MIFARE_Auth(authMode, block, key, uid) != 0) {
+                    result = -1;
+                    break;
+                }
+            }
+        }
+        
+        // Lanzar el READ y, mientras tanto, entregar el bloque anterior
+        frame[0] = MIFARE_CMD_READ;
+        frame[1] = block;
+        len = RC522_AppendCRC(frame, 2);
+        RC522_Start(RC522_CMD_READ, frame, len);
+        read_stats.reads++;
+        
+        if(havePrev && handler) {
+            handler(block - 1, buf[cur ^ 1]);
+        }
+        
+        backLen = sizeof(buf[cur]);
+        if(RC522_Finish(RC522_CMD_READ, buf[cur], &backLen, NULL) != MI_OK ||
+           mifare_check_read(buf[cur], backLen) != 0) {
+            havePrev = 0;
+            result = -1;
+            break;
+        }
+        
+        if(data) {
+            memcpy(&data[i * 16], buf[cur], 16);
+        }
+        read_stats.blocks++;
+        havePrev = 1;
+        cur ^= 1;
+    }
+    
+    // Último bloque
+    if(havePrev && handler) {
+        handler(first + read_stats.blocks - 1, buf[cur ^ 1]);
+    }
+    
+    read_stats.micros = micros() - start;
+    return result;
+}
+
+int MIFARE_ReadSector(uint8_t sector, uint8_t authMode, uint8_t *key,
+                      uint8_t *uid, uint8_t *data, MIFARE_BlockHandler handler) {
+    return MIFARE_ReadBlocks(MIFARE_SectorFirstBlock(sector), MIFARE_SectorBlockCount(sector),
+                             authMode, key, uid, data, handler);
+}
+
+const MIFARE_ReadStats *MIFARE_GetReadStats(void) {
+    return &read_stats;
+}
+
+/**
+ * Escribir un bloque en la sesión Crypto1 abierta por la lectura del
+ * sector: sin nueva autenticación. Un NAK cierra la sesión en la tarjeta;
+ * solo entonces se vuelve a seleccionar (WUPA + SELECT del UID conocido),
+ * se autentica y se reintenta una vez.
+ */
+int MIFARE_WriteInSession(uint8_t blockAddr, uint8_t *writeData, uint8_t verify,
+                          uint8_t authMode, uint8_t *key, uint8_t *uid) {
+    uint8_t readBack[18];
+    int result = MIFARE_Write(blockAddr, writeData);
+    
+    if(result == MIFARE_NAK) {
+        RC522_Uid again;
+        RC522_StopCrypto1();
+        if(RC522_Reselect(&again) != 0 ||
+           MIFARE_Auth(authMode, blockAddr, key, uid) != 0) {
+            return MIFARE_NAK;
+        }
+        result = MIFARE_Write(blockAddr, writeData);
+    }
+    
+    if(result != 0 || !verify) {
+        return result;
+    }
+    
+    // Relectura en la misma sesión
+    if(MIFARE_Read(blockAddr, readBack) != 0) {
+        return MIFARE_ERR;
+    }
+    return (memcmp(readBack, writeData, 16) == 0) ? 0 : MIFARE_VERIFY_FAIL;
+}
+
+// =================== Ultralight / NTAG21x ===================
+
+// Tipo por GET_VERSION: [2] tipo de producto (0x03 Ultralight, 0x04 NTAG)
+// y [6] tamaño de memoria
+static const struct {
+    uint8_t product;
+    uint8_t storage;
+    MIFARE_ULType type;
+    uint8_t pages;
+    const char *name;
+} ul_types[] = {
+    { 0x03, 0x0B, MIFARE_UL_EV1_MF0UL11, 20,  "Ultralight EV1 (MF0UL11)" },
+    { 0x03, 0x0E, MIFARE_UL_EV1_MF0UL21, 41,  "Ultralight EV1 (MF0UL21)" },
+    { 0x04, 0x0F, MIFARE_UL_NTAG213,     45,  "NTAG213" },
+    { 0x04, 0x11, MIFARE_UL_NTAG215,     135, "NTAG215" },
+    { 0x04, 0x13, MIFARE_UL_NTAG216,     231, "NTAG216" },
+};
+
+#define UL_TYPES    (sizeof(ul_types) / sizeof(ul_types[0]))
+
+// Respuesta de una trama FAST_READ + CRC en modo software (static: la
+// pila es de 1 KB)
+static uint8_t ul_buf[MIFARE_UL_FAST_READ_PAGES * 4 + 2];
+
+// Longitud esperada y CRC de una respuesta de n bytes de datos
+static int ul_check(uint8_t *data, uint16_t n, uint16_t backLen) {
+    uint8_t crc[2];
+    
+    if(RC522_CRCOffload()) {
+        return (backLen == n) ? 0 : MIFARE_ERR;
+    }
+    if(backLen != n + 2) {
+        return MIFARE_ERR;
+    }
+    RC522_CalculateCRC(data, n, crc);
+    return (crc[0] == data[n] && crc[1] == data[n + 1]) ? 0 : MIFARE_ERR;
+}
+
+const char *MIFARE_UL_TypeName(MIFARE_ULType type) {
+    if(type == MIFARE_UL_ULTRALIGHT) {
+        return "Ultralight";
+    }
+    for(uint8_t i = 0; i < UL_TYPES; i++) {
+        if(ul_types[i].type == type) {
+            return ul_types[i].name;
+        }
+    }
+    return "desconocido";
+}
+
+/**
+ * GET_VERSION: identifica EV1/NTAG y su tamaño. Un Ultralight original
+ * no lo implementa y responde NAK (queda en IDLE): en ese caso se
+ * vuelve a seleccionar con WUPA + SELECT y se asume Ultralight (16 pág.)
+ */
+int MIFARE_UL_GetVersion(MIFARE_ULInfo *info) {
+    uint8_t frame[4];
+    uint8_t back[10];
+    uint8_t backLen = sizeof(back);
+    uint8_t len;
+    
+    memset(info, 0, sizeof(*info));
+    
+    frame[0] = MIFARE_UL_GET_VERSION;
+    len = RC522_AppendCRC(frame, 1);
+    
+    if(RC522_Execute(RC522_CMD_READ, frame, len, back, &backLen, NULL) != MI_OK ||
+       ul_check(back, 8, backLen) != 0) {
+        RC522_Uid again;
+        info->type = MIFARE_UL_ULTRALIGHT;
+        info->pages = 16;
+        return RC522_Reselect(&again);
+    }
+    
+    memcpy(info->version, back, 8);
+    for(uint8_t i = 0; i < UL_TYPES; i++) {
+        if(back[2] == ul_types[i].product && back[6] == ul_types[i].storage) {
+            info->type = ul_types[i].type;
+            info->pages = ul_types[i].pages;
+            return 0;
+        }
+    }
+    
+    // Versión no catalogada: solo se garantizan las 16 primeras páginas
+    info->type = MIFARE_UL_UNKNOWN;
+    info->pages = 16;
+    return 0;
+}
+
+/**
+ * READ: 4 páginas (16 bytes) desde page. data: 18 bytes
+ */
+int MIFARE_UL_Read(uint8_t page, uint8_t *data) {
+    uint8_t frame[4];
+    uint8_t backLen = 18;
+    uint8_t len;
+    
+    frame[0] = MIFARE_UL_READ;
+    frame[1] = page;
+    len = RC522_AppendCRC(frame, 2);
+    
+    if(RC522_Execute(RC522_CMD_READ, frame, len, data, &backLen, NULL) != MI_OK) {
+        return MIFARE_ERR;
+    }
+    return ul_check(data, 16, backLen);
+}
+
+/**
+ * FAST_READ de las páginas first..last (incluidas) en tramas de hasta
+ * MIFARE_UL_FAST_READ_PAGES páginas. data: 4 * (last - first + 1) bytes
+ */
+int MIFARE_UL_FastRead(uint8_t first, uint8_t last, uint8_t *data) {
+    uint8_t frame[5];
+    uint8_t len;
+    uint32_t start = micros();
+    
+    memset(&read_stats, 0, sizeof(read_stats));
+    
+    while(first <= last) {
+        uint8_t end = last;
+        if(end - first + 1 > MIFARE_UL_FAST_READ_PAGES) {
+            end = first + MIFARE_UL_FAST_READ_PAGES - 1;
+        }
+        uint16_t n = (uint16_t)(end - first + 1) * 4;
+        uint16_t backLen = sizeof(ul_buf);
+        
+        frame[0] = MIFARE_UL_FAST_READ;
+        frame[1] = first;
+        frame[2] = end;
+        len = RC522_AppendCRC(frame, 3);
+        
+        read_stats.reads++;
+        if(RC522_ExecuteLong(RC522_CMD_READ, frame, len, ul_buf, &backLen) != MI_OK ||
+           ul_check(ul_buf, n, backLen) != 0) {
+            read_stats.micros = micros() - start;
+            return MIFARE_ERR;
+        }
+        
+        memcpy(data, ul_buf, n);
+        data += n;
+        read_stats.blocks += end - first + 1;   // Páginas
+        
+        if(end == 0xFF) {
+            break;
+        }
+        first = end + 1;
+    }
+    
+    read_stats.micros = micros() - start;
+    return 0;
+}
+
+/**
+ * Lectura de páginas según el tipo: FAST_READ si existe, si no READ de
+ * 4 en 4 páginas
+ */
+int MIFARE_UL_ReadPages(const MIFARE_ULInfo *info, uint8_t first, uint8_t last,
+                        uint8_t *data) {
+    uint8_t buf[18];
+    uint32_t start = micros();
+    
+    if(info->type != MIFARE_UL_ULTRALIGHT && info->type != MIFARE_UL_UNKNOWN) {
+        return MIFARE_UL_FastRead(first, last, data);
+    }
+    
+    memset(&read_stats, 0, sizeof(read_stats));
+    
+    for(uint16_t page = first; page <= last; page += 4) {
+        read_stats.reads++;
+        if(MIFARE_UL_Read((uint8_t)page, buf) != 0) {
+            read_stats.micros = micros() - start;
+            return MIFARE_ERR;
+        }
+        uint16_t n = (last - page + 1 < 4) ? (uint16_t)(last - page + 1) * 4 : 16;
+        memcpy(data, buf, n);
+        data += n;
+        read_stats.blocks += n / 4;
+    }
+    
+    read_stats.micros = micros() - start;
+    return 0;
+}
+
+/**
+ * WRITE (0xA2): una página de 4 bytes, respuesta ACK/NAK de 4 bits
+ */
+int MIFARE_UL_Write(uint8_t page, const uint8_t *data) {
+    uint8_t frame[8];
+    uint8_t ack[2];
+    uint8_t ackLen = sizeof(ack);
+    uint8_t len;
+    
+    frame[0] = MIFARE_UL_WRITE;
+    frame[1] = page;
+    memcpy(&frame[2], data, 4);
+    len = RC522_AppendCRC(frame, 6);
+    
+    if(RC522_Execute(RC522_CMD_WRITE, frame, len, ack, &ackLen, NULL) != MI_OK) {
+        return MIFARE_ERR;
+    }
+    return mifare_check_ack(ack, ackLen);
+}
@@ -4,6 +4,84 @@
 #include <stdint.h>
 #include "rc522.h"
 
+// ===== Familias de tarjeta (por SAK y ATQA, NXP AN10833) =====
+typedef enum {
+    MIFARE_FAMILY_UNKNOWN = 0,
+    MIFARE_FAMILY_MINI,         // SAK 0x09: 5 sectores
+    MIFARE_FAMILY_CLASSIC_1K,   // SAK 0x08 / 0x88 / 0x28 (SmartMX con Classic)
+    MIFARE_FAMILY_CLASSIC_4K,   // SAK 0x18 / 0x38
+    MIFARE_FAMILY_ULTRALIGHT,   // SAK 0x00: Ultralight, NTAG21x
+    MIFARE_FAMILY_PLUS_SL2,     // SAK 0x10 / 0x11: auth AES, no soportada
+    MIFARE_FAMILY_ISO14443_4    // SAK bit 5: DESFire, Plus SL3, EMV...
+} MIFARE_Family;
+
+// ===== Comandos MIFARE Classic =====
+#define MIFARE_CMD_READ     0x30
+#define MIFARE_CMD_WRITE    0xA0
+
+// ===== Comandos MIFARE Ultralight / NTAG21x =====
+// Páginas de 4 bytes, sin autenticación Crypto1. READ devuelve 4 páginas
+#define MIFARE_UL_READ          0x30
+#define MIFARE_UL_GET_VERSION   0x60
+#define MIFARE_UL_FAST_READ     0x3A
+#define MIFARE_UL_WRITE         0xA2
+
+#define MIFARE_UL_USER_PAGE     4       // Primera página de usuario
+#define MIFARE_UL_MAX_PAGES     231     // NTAG216
+
+// Páginas por trama FAST_READ (128 bytes: dos FIFOs vaciados al vuelo)
+#ifndef MIFARE_UL_FAST_READ_PAGES
+#define MIFARE_UL_FAST_READ_PAGES   32
+#endif
+
+typedef enum {
+    MIFARE_UL_UNKNOWN = 0,
+    MIFARE_UL_ULTRALIGHT,       // Sin GET_VERSION ni FAST_READ
+    MIFARE_UL_EV1_MF0UL11,
+    MIFARE_UL_EV1_MF0UL21,
+    MIFARE_UL_NTAG213,
+    MIFARE_UL_NTAG215,
+    MIFARE_UL_NTAG216
+} MIFARE_ULType;
+
+typedef struct {
+    MIFARE_ULType type;
+    uint8_t pages;              // Páginas totales (incluidas config/lock)
+    uint8_t version[8];         // Respuesta de GET_VERSION (0 si no hay)
+} MIFARE_ULInfo;
+
+// ===== Códigos de retorno (0 = correcto) =====
+#define MIFARE_ERR          (-1)
+#define MIFARE_NAK          (-2)    // La tarjeta respondió NAK: sesión Crypto1 perdida
+#define MIFARE_VERIFY_FAIL  (-3)    // La relectura no coincide con lo escrito
+
+// ACK de 4 bits de WRITE
+#define MIFARE_ACK          0x0A
+
+// ===== Mapa de memoria (1K: sectores 0-15, 4K: 0-39) =====
+// Sectores 0-31: 4 bloques; sectores 32-39 (solo 4K): 16 bloques.
+// El último bloque de cada sector es el trailer (claves y accesos)
+#define MIFARE_1K_SECTORS   16
+#define MIFARE_4K_SECTORS   40
+#define MIFARE_MINI_SECTORS 5
+
+// Estadísticas de la última lectura de varios bloques
+typedef struct {
+    uint8_t blocks;          // Bloques leídos
+    uint8_t auths;           // Autenticaciones (una por sector)
+    uint8_t reads;           // Tramas READ
+    uint32_t micros;         // Duración total
+} MIFARE_ReadStats;
+
+// Recibe cada bloque leído mientras el siguiente READ está en curso: no
+// debe acceder al RC522
+typedef void (*MIFARE_BlockHandler)(uint8_t blockAddr, const uint8_t *data);
+
+// ===== Clasificación =====
+extern MIFARE_Family MIFARE_Classify(const RC522_Uid *card);
+extern const char *MIFARE_FamilyName(MIFARE_Family family);
+extern uint8_t MIFARE_SectorCount(MIFARE_Family family);
+
 // ===== Funciones auxiliares MIFARE =====
 extern void prepareWriteData(uint8_t levelCode, uint8_t *writeData);
 extern void printBlockDataFormatted(uint8_t *blockData);
@@ -13,4 +91,32 @@ extern int MIFARE_Read(uint8_t blockAddr, uint8_t *recvData);
 extern int MIFARE_Write(uint8_t blockAddr, uint8_t *writeData);
 extern int MIFARE_Auth(uint8_t authMode, uint8_t blockAddr, uint8_t *key, uint8_t *uid);
 
+// ===== Lectura por sectores =====
+extern uint8_t MIFARE_SectorFirstBlock(uint8_t sector);
+extern uint8_t MIFARE_SectorBlockCount(uint8_t sector);
+extern uint8_t MIFARE_BlockSector(uint8_t blockAddr);
+
+// data: 16 * count bytes (puede ser NULL si basta con handler)
+// key NULL: sesión ya abierta por Keys_Auth (no puede cruzar de sector)
+extern int MIFARE_ReadBlocks(uint8_t first, uint8_t count, uint8_t authMode,
+                             uint8_t *key, uint8_t *uid, uint8_t *data,
+                             MIFARE_BlockHandler handler);
+extern int MIFARE_ReadSector(uint8_t sector, uint8_t authMode, uint8_t *key,
+                             uint8_t *uid, uint8_t *data, MIFARE_BlockHandler handler);
+extern const MIFARE_ReadStats *MIFARE_GetReadStats(void);
+
+// ===== Ultralight / NTAG =====
+extern int MIFARE_UL_GetVersion(MIFARE_ULInfo *info);
+extern int MIFARE_UL_Read(uint8_t page, uint8_t *data);
+extern int MIFARE_UL_FastRead(uint8_t first, uint8_t last, uint8_t *data);
+extern int MIFARE_UL_ReadPages(const MIFARE_ULInfo *info, uint8_t first, uint8_t last,
+                               uint8_t *data);
+extern int MIFARE_UL_Write(uint8_t page, const uint8_t *data);
+extern const char *MIFARE_UL_TypeName(MIFARE_ULType type);
+
+// Escritura dentro de la sesión ya autenticada del sector (re-autentica
+// solo tras un NAK); verify: relee el bloque y lo compara
+extern int MIFARE_WriteInSession(uint8_t blockAddr, uint8_t *writeData, uint8_t verify,
+                                 uint8_t authMode, uint8_t *key, uint8_t *uid);
+
 #endif
@@ -0,0 +1,81 @@
+#include <string.h>
+#include "presence.h"
+#include "rc522.h"
+
+typedef struct {
+    RC522_Uid card;
+    uint8_t misses;          // Sondeos consecutivos sin respuesta
+} presence_entry_t;
+
+static presence_entry_t tracked[PRESENCE_MAX];
+static uint8_t tracked_count = 0;
+
+static int presence_find(const RC522_Uid *card) {
+    for(uint8_t i = 0; i < tracked_count; i++) {
+        if(tracked[i].card.size == card->size &&
+           memcmp(tracked[i].card.uid, card->uid, card->size) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void Presence_Reset(void) {
+    tracked_count = 0;
+}
+
+uint8_t Presence_Count(void) {
+    return tracked_count;
+}
+
+uint8_t Presence_Seen(const RC522_Uid *card) {
+    int i = presence_find(card);
+    if(i < 0) {
+        return 0;
+    }
+    tracked[i].misses = 0;
+    return 1;
+}
+
+int Presence_Add(const RC522_Uid *card) {
+    if(tracked_count >= PRESENCE_MAX) {
+        return -1;
+    }
+    tracked[tracked_count].card = *card;
+    tracked[tracked_count].misses = 0;
+    tracked_count++;
+    return 0;
+}
+
+uint8_t Presence_Probe(RC522_Uid *removed, uint8_t max) {
+    uint8_t n = 0;
+    uint8_t first = 1;
+    
+    // El primer sondeo usa WUPA y despierta todas las tarjetas en HALT; el
+    // SELECT de un UID devuelve las demás a IDLE. Los siguientes usan REQA:
+    // las ya sondeadas siguen en HALT y al final de la vuelta lo están
+    // todas (la siguiente pasada de inventario no las ve)
+    //
+    // Recorrido inverso: una retirada se sustituye por la última entrada
+    for(int i = tracked_count - 1; i >= 0; i--) {
+        int found = first ? RC522_SelectUid(&tracked[i].card)
+                          : RC522_SelectUidIdle(&tracked[i].card);
+        first = 0;
+        if(found == 0) {
+            RC522_HaltA();                  // Vuelve a HALT: REQA no la ve
+            tracked[i].misses = 0;
+            continue;
+        }
+        
+        if(++tracked[i].misses < PRESENCE_MISSES) {
+            continue;
+        }
+        
+        if(n < max) {
+            removed[n++] = tracked[i].card;
+        }
+        tracked[i] = tracked[--tracked_count];
+    }
+    
+    return n;
+}
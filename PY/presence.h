@@ -0,0 +1,31 @@
+#ifndef PRESENCE_H
+#define PRESENCE_H
+
+#include <stdint.h>
+#include "rc522.h"
+
+// ===== Seguimiento de tarjetas en el campo =====
+// Cada tarjeta procesada queda en HALT y se comprueba en cada periodo con
+// WUPA (la primera) o REQA (las demás) + SELECT de su UID y HLTA de nuevo:
+// tras la vuelta todas vuelven a estar en HALT. Tras PRESENCE_MISSES
+// sondeos sin respuesta se da por retirada.
+#ifndef PRESENCE_MAX
+#define PRESENCE_MAX        8
+#endif
+#define PRESENCE_MISSES     2
+
+// ===== Funciones =====
+extern void Presence_Reset(void);
+extern uint8_t Presence_Count(void);
+
+// 1 si la tarjeta ya estaba en seguimiento (y se marca como vista)
+extern uint8_t Presence_Seen(const RC522_Uid *card);
+
+// 0 si se añadió, -1 si la tabla está llena
+extern int Presence_Add(const RC522_Uid *card);
+
+// Sondea todas las tarjetas; copia en removed las retiradas (hasta max)
+// y devuelve cuántas son
+extern uint8_t Presence_Probe(RC522_Uid *removed, uint8_t max);
+
+#endif
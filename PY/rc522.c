@@ -1,23 +1,17 @@
 #include "rc522.h"
-#include "comusart.h"
+#include "crc_a.h"
+#include "usart.h"
+#include "conf.h"
 #include "stm32f446xx.h"
 #include <stdio.h>
+#include <string.h>
 
-// =================== DELAYS ======================
-void delay_ms(volatile uint32_t ms) {
-    // Corregido para 180MHz: ~45000 ciclos por ms
-    while(ms--) {
-        for (volatile int i = 0; i < 45000; i++);
-    }
-}
+// Contadores de tráfico SPI (ver RC522_GetStats)
+static RC522_Stats rc522_stats;
 
-void delay_us(volatile uint32_t us) {
-    // Para 180MHz: ~180 ciclos por microsegundo
-    us = us * 45;
-    while(us--) {
-        __NOP();
-    }
-}
+static void shadow_invalidate(void);
+
+static void rc522_link_error(void);
 
 // =================== UART ========================
 // NOTA: USART_Sendchar y USART_SendString están definidas en main.c
@@ -25,6 +19,7 @@ void delay_us(volatile uint32_t us) {
 // =================== GPIO CONTROL ================
 void RC522_ResetLow(void) { 
     GPIOA->BSRR = (1 << (8 + 16));  // PA8 LOW
+    shadow_invalidate();
 }
 
 void RC522_ResetHigh(void) { 
@@ -32,6 +27,22 @@ void RC522_ResetHigh(void) {
 }
 
 // =================== SPI COMMUNICATION ===========
+// Tiempos de NSS del MFRC522: 50 ns mínimos entre NSS bajo y el primer
+// flanco de SCK, y entre el último flanco y NSS alto. Antes se usaban
+// 2 us de guarda (40 veces más) en cada trama.
+#define RC522_CS_SETUP_CYCLES   TIMING_NS_TO_CYCLES(RC522_CS_SETUP_NS)
+#define RC522_CS_HOLD_CYCLES    TIMING_NS_TO_CYCLES(RC522_CS_HOLD_NS)
+
+static inline void rc522_cs_low(void) {
+    GPIOA->BSRR = (1 << (4 + 16));  // PA4 LOW
+    delay_cycles(RC522_CS_SETUP_CYCLES);
+}
+
+static inline void rc522_cs_high(void) {
+    delay_cycles(RC522_CS_HOLD_CYCLES);
+    GPIOA->BSRR = (1 << 4);         // PA4 HIGH
+}
+
 uint8_t spi_transfer(uint8_t data) {
     // Esperar buffer TX vac�o
     while(!(SPI1->SR & SPI_SR_TXE));
@@ -47,9 +58,10 @@ uint8_t spi_transfer(uint8_t data) {
 }
 
 void spi_rw(uint8_t *data, uint8_t count) {
+    rc522_stats.spiFrames++;
+    
     // CS LOW
-    GPIOA->BSRR = (1 << (4 + 16));
-    delay_us(2);
+    rc522_cs_low();
     
     // Transferir bytes
     for(uint8_t i = 0; i < count; i++) {
@@ -58,16 +70,162 @@ void spi_rw(uint8_t *data, uint8_t count) {
     
     // Esperar fin de transmisi�n
     while(SPI1->SR & SPI_SR_BSY);
-    delay_us(2);
     
     // CS HIGH
-    GPIOA->BSRR = (1 << 4);
+    rc522_cs_high();
+}
+
+// Modo 16 bits (SPI_CR1_DFF): dirección + dato en una sola trama, una
+// sola espera de TXE/RXNE. Devuelve la palabra recibida (dato en [7:0])
+static uint16_t spi_rw16(uint16_t frame) {
+    rc522_stats.spiFrames++;
+    
+    // CS LOW
+    rc522_cs_low();
+    
+    while(!(SPI1->SR & SPI_SR_TXE));
+    SPI1->DR = frame;
+    while(!(SPI1->SR & SPI_SR_RXNE));
+    frame = (uint16_t)SPI1->DR;
+    
+    // Esperar fin de transmisi�n
+    while(SPI1->SR & SPI_SR_BSY);
+    
+    // CS HIGH
+    rc522_cs_high();
+    
+    return frame;
 }
 
+// DFF solo puede cambiarse con el SPI deshabilitado
+static void spi_set_dff(uint8_t frame16) {
+    SPI1->CR1 &= ~SPI_CR1_SPE;
+    if(frame16) {
+        SPI1->CR1 |= SPI_CR1_DFF;
+    } else {
+        SPI1->CR1 &= ~SPI_CR1_DFF;
+    }
+    SPI1->CR1 |= SPI_CR1_SPE;
+}
+
+// =================== SPI DMA BURST ===============
+// SPI1_RX = DMA2 Stream0 / SPI1_TX = DMA2 Stream3 (canal 3, ver confDMA)
+// Un byte extra para la dirección al inicio de la trama
+static uint8_t dma_tx[RC522_FIFO_SIZE + 1];
+static uint8_t dma_rx[RC522_FIFO_SIZE + 1];
+
+static void spi_dma_rw(uint8_t count) {
+    // Las ráfagas van siempre en 8 bits
+    uint8_t frame16 = (SPI1->CR1 & SPI_CR1_DFF) ? 1 : 0;
+    if(frame16) {
+        spi_set_dff(0);
+    }
+    
+    rc522_stats.spiFrames++;
+    
+    // CS LOW
+    rc522_cs_low();
+    
+    // Descartar cualquier byte pendiente en DR
+    if(SPI1->SR & SPI_SR_RXNE) {
+        (void)SPI1->DR;
+    }
+    
+    // Limpiar flags de ambos streams
+    DMA2->LIFCR = DMA_LIFCR_CTCIF0 | DMA_LIFCR_CHTIF0 | DMA_LIFCR_CTEIF0 |
+                  DMA_LIFCR_CDMEIF0 | DMA_LIFCR_CFEIF0 |
+                  DMA_LIFCR_CTCIF3 | DMA_LIFCR_CHTIF3 | DMA_LIFCR_CTEIF3 |
+                  DMA_LIFCR_CDMEIF3 | DMA_LIFCR_CFEIF3;
+    
+    DMA2_Stream0->M0AR = (uint32_t)dma_rx;
+    DMA2_Stream0->NDTR = count;
+    DMA2_Stream3->M0AR = (uint32_t)dma_tx;
+    DMA2_Stream3->NDTR = count;
+    
+    // RX primero para no perder el primer byte, luego TX arranca el reloj
+    SPI1->CR2 |= SPI_CR2_RXDMAEN;
+    DMA2_Stream0->CR |= DMA_SxCR_EN;
+    DMA2_Stream3->CR |= DMA_SxCR_EN;
+    SPI1->CR2 |= SPI_CR2_TXDMAEN;
+    
+    // RX termina último: cuando llega el último byte la trama está completa.
+    // Plazo: 65 bytes a 352 kHz (divisor más lento) son ~1.5 ms
+    uint32_t deadline = deadline_us(RC522_DMA_TIMEOUT_US);
+    uint8_t timedOut = 0;
+    while(!(DMA2->LISR & DMA_LISR_TCIF0)) {
+        if(deadline_expired(deadline, micros())) {
+            timedOut = 1;
+            break;
+        }
+    }
+    
+    SPI1->CR2 &= ~(SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN);
+    if(timedOut) {
+        // Abortar ambos streams; la trama se descarta como error de enlace
+        DMA2_Stream0->CR &= ~DMA_SxCR_EN;
+        DMA2_Stream3->CR &= ~DMA_SxCR_EN;
+        while((DMA2_Stream0->CR | DMA2_Stream3->CR) & DMA_SxCR_EN);
+    }
+    
+    // Esperar fin de transmisión
+    while(SPI1->SR & SPI_SR_BSY);
+    
+    // CS HIGH
+    rc522_cs_high();
+    
+    if(frame16) {
+        spi_set_dff(1);
+    }
+    
+    if(timedOut) {
+        rc522_link_error();
+    }
+}
+
+// =================== SHADOW REGISTERS ============
+// Copia local de los registros que solo modifica el MCU. Set/ClearBitMask
+// sobre ellos se resuelven con una única escritura SPI, y las escrituras
+// que no cambian el valor se omiten. Los registros de estado (CommIrqReg,
+// ErrorReg, Status2Reg, FIFOLevelReg, ControlReg, CommandReg...) los
+// modifica el propio RC522 y siempre se leen por SPI.
+#define SHADOW_BIT(reg)     ((uint64_t)1 << (reg))
+
+static const uint64_t shadow_cacheable =
+    SHADOW_BIT(CommIEnReg)    | SHADOW_BIT(DivIEnReg)     |
+    SHADOW_BIT(BitFramingReg) | SHADOW_BIT(ModeReg)       |
+    SHADOW_BIT(TxModeReg)     | SHADOW_BIT(RxModeReg)     |
+    SHADOW_BIT(TxControlReg)  | SHADOW_BIT(TxASKReg)      |
+    SHADOW_BIT(RFCfgReg)      | SHADOW_BIT(TModeReg)      |
+    SHADOW_BIT(TPrescalerReg) | SHADOW_BIT(TReloadRegH)   |
+    SHADOW_BIT(TReloadRegL);
+
+static uint8_t shadow_regs[0x40];
+static uint64_t shadow_valid = 0;
+
+// Tras un reset (soft o hard) el RC522 vuelve a sus valores por defecto
+static void shadow_invalidate(void) {
+    shadow_valid = 0;
+}
+
+void RC522_ResetStats(void) {
+    memset(&rc522_stats, 0, sizeof(rc522_stats));
+}
+
+const RC522_Stats *RC522_GetStats(void) {
+    return &rc522_stats;
+}
+
+
 // =================== RC522 REGISTERS =============
-void RC522_WriteReg(uint8_t addr, uint8_t val) {
+static void rc522_spi_write(uint8_t addr, uint8_t val) {
     uint8_t frame[2];
     
+    rc522_stats.regWrites++;
+    if(SPI1->CR1 & SPI_CR1_DFF) {
+        spi_rw16((uint16_t)(((addr << 1) & 0x7E) << 8) | val);
+        return;
+    }
+    
     // Direcci�n de escritura: (addr << 1) & 0x7E
     // Bit 0 = 0 (write), Bit 7 = 0 (no address increment)
     frame[0] = (addr << 1) & 0x7E;
@@ -76,9 +234,14 @@ void RC522_WriteReg(uint8_t addr, uint8_t val) {
     spi_rw(frame, 2);
 }
 
-uint8_t RC522_ReadReg(uint8_t addr) {
+static uint8_t rc522_spi_read(uint8_t addr) {
     uint8_t frame[2];
     
+    rc522_stats.regReads++;
+    if(SPI1->CR1 & SPI_CR1_DFF) {
+        return (uint8_t)(spi_rw16((uint16_t)((((addr << 1) & 0x7E) | 0x80) << 8)) & 0xFF);
+    }
+    
     // Direcci�n de lectura: ((addr << 1) & 0x7E) | 0x80
     // Bit 0 = 1 (read), Bit 7 = 0 (no address increment)
     frame[0] = ((addr << 1) & 0x7E) | 0x80;
@@ -90,6 +253,90 @@ uint8_t RC522_ReadReg(uint8_t addr) {
     return frame[1];
 }
 
+void RC522_WriteReg(uint8_t addr, uint8_t val) {
+    addr &= 0x3F;
+    
+    if(shadow_cacheable & SHADOW_BIT(addr)) {
+        // Escritura redundante: el registro ya tiene ese valor
+        if((shadow_valid & SHADOW_BIT(addr)) && shadow_regs[addr] == val) {
+            rc522_stats.writesSkipped++;
+            return;
+        }
+        shadow_regs[addr] = val;
+        shadow_valid |= SHADOW_BIT(addr);
+    }
+    
+    rc522_spi_write(addr, val);
+}
+
+uint8_t RC522_ReadReg(uint8_t addr) {
+    addr &= 0x3F;
+    
+    if(shadow_cacheable & SHADOW_BIT(addr)) {
+        if(shadow_valid & SHADOW_BIT(addr)) {
+            rc522_stats.shadowHits++;
+            return shadow_regs[addr];
+        }
+        shadow_regs[addr] = rc522_spi_read(addr);
+        shadow_valid |= SHADOW_BIT(addr);
+        return shadow_regs[addr];
+    }
+    
+    return rc522_spi_read(addr);
+}
+
+// Ciclos de CPU por lectura de registro (VersionReg) en 8 y 16 bits.
+// Deja el SPI en el modo en que estaba
+void RC522_BenchRegAccess(uint32_t *cycles8, uint32_t *cycles16) {
+    uint8_t prev = (SPI1->CR1 & SPI_CR1_DFF) ? SPI_MODE_16BIT : SPI_MODE_8BIT;
+    uint32_t start;
+    
+    confSPIMode(SPI_MODE_8BIT);
+    start = Timing_Cycles();
+    for(uint8_t i = 0; i < RC522_BENCH_LOOPS; i++) {
+        (void)rc522_spi_read(VersionReg);
+    }
+    *cycles8 = (Timing_Cycles() - start) / RC522_BENCH_LOOPS;
+    
+    confSPIMode(SPI_MODE_16BIT);
+    start = Timing_Cycles();
+    for(uint8_t i = 0; i < RC522_BENCH_LOOPS; i++) {
+        (void)rc522_spi_read(VersionReg);
+    }
+    *cycles16 = (Timing_Cycles() - start) / RC522_BENCH_LOOPS;
+    
+    confSPIMode(prev);
+}
+
+// Escribe len bytes en FIFODataReg con una sola activación de CS
+void RC522_WriteFIFO(const uint8_t *data, uint8_t len) {
+    if(len == 0) return;
+    if(len > RC522_FIFO_SIZE) len = RC522_FIFO_SIZE;
+    
+    // Dirección de escritura una vez, luego los datos
+    dma_tx[0] = (FIFODataReg << 1) & 0x7E;
+    memcpy(&dma_tx[1], data, len);
+    
+    spi_dma_rw(len + 1);
+}
+
+// Lee len bytes de FIFODataReg con una sola activación de CS
+void RC522_ReadFIFO(uint8_t *data, uint8_t len) {
+    if(len == 0) return;
+    if(len > RC522_FIFO_SIZE) len = RC522_FIFO_SIZE;
+    
+    // La dirección de lectura se repite por cada byte; el RC522 devuelve
+    // el dato del byte anterior, así que la trama termina con 0x00
+    memset(dma_tx, ((FIFODataReg << 1) & 0x7E) | 0x80, len);
+    dma_tx[len] = 0x00;
+    
+    spi_dma_rw(len + 1);
+    
+    memcpy(data, &dma_rx[1], len);
+}
+
+// En registros cacheados ReadReg no toca el bus: la máscara cuesta una
+// sola escritura (o ninguna si el bit ya tenía ese valor)
 void RC522_SetBitMask(uint8_t reg, uint8_t mask) {
     RC522_WriteReg(reg, RC522_ReadReg(reg) | mask);
 }
@@ -98,436 +345,880 @@ void RC522_ClearBitMask(uint8_t reg, uint8_t mask) {
     RC522_WriteReg(reg, RC522_ReadReg(reg) & (~mask));
 }
 
-// =================== RC522 INIT ==================
-void RC522_Init(void) {
-    // 1. Soft Reset
-    RC522_WriteReg(CommandReg, PCD_SoftReset);
-    delay_ms(50);
-    
-    // 2. Clear FIFO e interrupciones
-    RC522_WriteReg(FIFOLevelReg, 0x80);
-    RC522_WriteReg(CommIrqReg, 0x7F);
+// =================== SPI AUTOTUNE ================
+// APB2 = 90 MHz, SCK = 90 MHz / 2^(BR+1). Se prueba desde el divisor más
+// lento hacia el más rápido permitido y se queda el último que supera la
+// prueba de enlace. Si luego se acumulan errores se baja un escalón.
+static RC522_LinkStats link_stats;
+
+// Reescribe los registros en caché con el valor que debería tener el RC522
+static void shadow_restore(void) {
+    for(uint8_t reg = 0; reg < 0x40; reg++) {
+        if(shadow_valid & SHADOW_BIT(reg)) {
+            rc522_spi_write(reg, shadow_regs[reg]);
+        }
+    }
+}
+
+// VersionReg válidos: 0x91/0x92 (MFRC522 v1/v2), 0x88 (FM17522), 0x12 (clon)
+static uint8_t rc522_version_ok(uint8_t v) {
+    return (v == 0x91 || v == 0x92 || v == 0x88 || v == 0x12);
+}
+
+// Prueba de enlace: VersionReg + escritura y lectura del FIFO completo
+uint8_t RC522_LinkTest(void) {
+    uint8_t pattern[RC522_FIFO_SIZE];
+    uint8_t readback[RC522_FIFO_SIZE];
     
-    // 3. Timer configuration
-    RC522_WriteReg(TModeReg, 0x8D);        // TAuto=1, timer auto-reload
-    RC522_WriteReg(TPrescalerReg, 0x3E);   
-    RC522_WriteReg(TReloadRegH, 0x00);     
-    RC522_WriteReg(TReloadRegL, 30);       
+    if(!rc522_version_ok(rc522_spi_read(VersionReg))) {
+        return 0;
+    }
     
-    // 4. Modulaci�n ASK 100%
-    RC522_WriteReg(TxASKReg, 0x40);
+    // Patrón con transiciones 0/1 en todos los bits
+    for(uint8_t i = 0; i < RC522_FIFO_SIZE; i++) {
+        pattern[i] = (i & 1) ? (uint8_t)~i : (uint8_t)(0x55 ^ i);
+    }
     
-    // 5. Modo config
-    RC522_WriteReg(ModeReg, 0x3D);
+    rc522_spi_write(CommandReg, PCD_Idle);
+    rc522_spi_write(FIFOLevelReg, 0x80);
+    RC522_WriteFIFO(pattern, RC522_FIFO_SIZE);
     
-    // 6. Configurar RxGain - M�XIMA SENSIBILIDAD
-    RC522_WriteReg(RFCfgReg, 0x7F);
+    if((rc522_spi_read(FIFOLevelReg) & 0x7F) != RC522_FIFO_SIZE) {
+        rc522_spi_write(FIFOLevelReg, 0x80);
+        return 0;
+    }
     
-    // 7. Inicializar CommandReg
-    RC522_WriteReg(CommandReg, PCD_Idle);
+    RC522_ReadFIFO(readback, RC522_FIFO_SIZE);
+    rc522_spi_write(FIFOLevelReg, 0x80);
     
-    delay_ms(10);
+    return memcmp(pattern, readback, RC522_FIFO_SIZE) == 0;
 }
 
-// =================== RC522_ToCard (CORE TRANSCEIVE) =================
-/**
- * This is the CRITICAL function - mirrors STM32F103 reference implementation
- * Handles ALL transceive operations with proper command-specific IRQ setup
- */
-int RC522_ToCard(uint8_t command, uint8_t *sendData, uint8_t sendLen,
-                 uint8_t *backData, uint16_t *backLen) {
+// Devuelve el divisor elegido (BR) o 0xFF si ninguno pasa la prueba
+uint8_t RC522_AutotuneSPI(void) {
+    uint8_t best = 0xFF;
+    
+    for(int8_t br = RC522_SPI_BR_SLOWEST; br >= RC522_SPI_BR_FASTEST; br--) {
+        confSPIPrescaler((uint8_t)br);
+        if(!RC522_LinkTest() || !RC522_LinkTest()) {
+            break;                      // Más rápido ya no es fiable
+        }
+        best = (uint8_t)br;
+    }
     
-    uint8_t status = MI_ERR;
-    uint8_t irqEn = 0x00;
-    uint8_t waitIRq = 0x00;
-    uint8_t lastBits;
-    uint8_t n;
-    uint16_t i;
+    // Sin ningún divisor válido: volver al valor conservador de confSPI
+    confSPIPrescaler(best != 0xFF ? best : SPI_BR_DEFAULT);
+    link_stats.prescaler = best != 0xFF ? best : SPI_BR_DEFAULT;
+    link_stats.errors = 0;
+    
+    return best;
+}
 
-    // Step 1: Set up interrupt based on command type
-    switch (command) {
-        case PCD_AUTHENT:       // Authentication
-            irqEn = 0x12;       // Enable bits 1 and 4
-            waitIRq = 0x10;     // Wait for IdleIRq (bit 4) only
-            break;
-        case PCD_Transceive:    // Transmit/Receive
-            irqEn = 0x77;       // Enable bits 0,1,2,4,5,6
-            waitIRq = 0x30;     // Wait for RxIRq (bit 5) or IdleIRq (bit 4)
+// Error de enlace detectado en tiempo de ejecución (lectura imposible)
+static void rc522_link_error(void) {
+    link_stats.errors++;
+    link_stats.totalErrors++;
+    
+    if(link_stats.errors < RC522_LINK_ERR_MAX) {
+        return;
+    }
+    
+    // Demasiados errores: bajar un escalón hasta que la prueba pase
+    link_stats.errors = 0;
+    while(link_stats.prescaler < RC522_SPI_BR_SLOWEST) {
+        link_stats.prescaler++;
+        link_stats.fallbacks++;
+        confSPIPrescaler(link_stats.prescaler);
+        if(RC522_LinkTest()) {
             break;
-        default:
-            return status;
+        }
     }
+    
+    // Las escrituras con errores pudieron corromper la configuración
+    shadow_restore();
+}
 
-    // Step 2: Setup interrupts
-    RC522_WriteReg(CommIEnReg, irqEn | 0x80);    // Enable interrupts + Enable IRQ push-pull
-    RC522_WriteReg(CommIrqReg, 0x7F);             // Clear all interrupt flags
-    RC522_SetBitMask(FIFOLevelReg, 0x80);         // Flush FIFO
+// Comprobación periódica: VersionReg debe seguir siendo válido
+uint8_t RC522_LinkCheck(void) {
+    if(rc522_version_ok(rc522_spi_read(VersionReg))) {
+        return 1;
+    }
+    rc522_link_error();
+    return 0;
+}
 
-    // Step 3: Go to IDLE state
-    RC522_WriteReg(CommandReg, PCD_Idle);
+const RC522_LinkStats *RC522_GetLinkStats(void) {
+    return &link_stats;
+}
 
-    // Step 4: Write data to FIFO
-    for (i = 0; i < sendLen; i++) {
-        RC522_WriteReg(FIFODataReg, sendData[i]);
-    }
+// =================== RC522 TIMER =================
+// f_timer = 13.56 MHz / (2 * TPrescaler + 1), con TPrescaler de 12 bits
+// (TModeReg[3:0] : TPrescalerReg). TAuto=1: arranca al terminar de
+// transmitir y se detiene al recibir los primeros bits de la respuesta.
+// guardUs: plazo del MCU si el TimerIRq no llega (RC522 colgado o sin
+// línea IRQ): periodo del timer + tiempo de trama + margen
+typedef struct {
+    uint8_t tmode;
+    uint8_t prescaler;
+    uint16_t reload;
+    uint32_t guardUs;
+} rc522_timer_t;
+
+// Por defecto: TPrescaler 0xD3E -> ~2 kHz (0.5 ms), reload 30 -> 15 ms
+static const rc522_timer_t timer_default = { 0x8D, 0x3E, 30, 25000 };
+
+// REQA: TPrescaler 169 -> 40 kHz (25 us), reload 40 -> 1 ms. El ATQA llega
+// ~90 us después del REQA, así que sin tarjeta el sondeo acaba en ~1 ms
+static const rc522_timer_t timer_reqa = { 0x80, 0xA9, 40, 3000 };
+
+static RC522_PollStats poll_stats;
+
+static void rc522_set_timer(const rc522_timer_t *t) {
+    // Registros en caché: solo se escriben los que cambian
+    RC522_WriteReg(TModeReg, t->tmode);
+    RC522_WriteReg(TPrescalerReg, t->prescaler);
+    RC522_WriteReg(TReloadRegH, (uint8_t)(t->reload >> 8));
+    RC522_WriteReg(TReloadRegL, (uint8_t)(t->reload & 0xFF));
+}
+
+const RC522_PollStats *RC522_GetPollStats(void) {
+    return &poll_stats;
+}
+
+// =================== CRC OFFLOAD =================
+// Con el modo offload activo el RC522 añade el CRC_A al transmitir
+// (TxModeReg.TxCRCEn) y lo verifica al recibir (RxModeReg.RxCRCEn), sin
+// guardarlo en el FIFO. Cada trama declara qué sentidos llevan CRC.
+static uint8_t crc_offload = RC522_CRC_OFFLOAD;
 
-    // Step 5: Execute command
-    RC522_WriteReg(CommandReg, command);
-    if (command == PCD_Transceive) {
-        RC522_SetBitMask(BitFramingReg, 0x80);   // Start transmission
+void RC522_SetCRCOffload(uint8_t enable) {
+    crc_offload = enable ? 1 : 0;
+}
+
+uint8_t RC522_CRCOffload(void) {
+    return crc_offload;
+}
+
+// Modo software: añade el CRC_A al final de buf y devuelve la nueva
+// longitud. Modo offload: no toca nada, el RC522 lo añade al transmitir
+uint8_t RC522_AppendCRC(uint8_t *buf, uint8_t len) {
+    if(crc_offload) {
+        return len;
     }
+    RC522_CalculateCRC(buf, len, &buf[len]);
+    return len + 2;
+}
 
-    // Step 6: Wait for completion (up to 2000 loops ≈ 25ms)
-    i = 2000;
-    do {
-        n = RC522_ReadReg(CommIrqReg);
-        i--;
-    } while ((i != 0) && !(n & 0x01) && !(n & waitIRq));
-
-    RC522_ClearBitMask(BitFramingReg, 0x80);     // Stop transmission
-
-    // Step 7: Check for success
-    if (i != 0) {
-        // Check error register - 0x1B = BufferOvfl | CollErr | CRCErr | ProtocolErr
-        if (!(RC522_ReadReg(ErrorReg) & 0x1B)) {
-            status = MI_OK;
-            
-            if (n & irqEn & 0x01) {
-                status = MI_NOTAGERR;
-            }
+static void rc522_set_crc(uint8_t policy) {
+    if(!crc_offload) {
+        policy = RC522_CRC_NONE;
+    }
+    // Registros en caché: solo se escribe al cambiar de política
+    RC522_WriteReg(TxModeReg, (policy & RC522_CRC_TX) ? TxCRCEn : 0x00);
+    RC522_WriteReg(RxModeReg, (policy & RC522_CRC_RX) ? RxCRCEn : 0x00);
+}
 
-            // Step 8: Read received data (for PCD_Transceive)
-            if (command == PCD_Transceive) {
-                n = RC522_ReadReg(FIFOLevelReg);
-                lastBits = RC522_ReadReg(ControlReg) & 0x07;
-                
-                if (lastBits) {
-                    *backLen = (n - 1) * 8 + lastBits;
-                } else {
-                    *backLen = n * 8;
-                }
+// =================== IRQ (PA0 / EXTI0) ===========
+// Con IRqInv=1 (CommIEnReg bit 7) y IRQPushPull=1 (DivIEnReg bit 7) la
+// línea IRQ del RC522 pasa a BAJO cuando se activa cualquier bit habilitado
+// de CommIrqReg. La espera duerme en WFI hasta ese flanco en vez de leer
+// CommIrqReg por SPI en bucle.
+#if RC522_USE_IRQ
+static volatile uint8_t irq_armed = 0;
+static volatile uint8_t irq_done = 0;
+static volatile uint8_t irq_latched = 0;
 
-                if (n == 0) {
-                    n = 1;
-                }
-                if (n > 16) {
-                    n = 16;
-                }
+void EXTI0_IRQHandler(void) {
+    EXTI->PR = EXTI_PR_PR0;
+    
+    // Solo se lee CommIrqReg si el hilo principal está dormido esperando:
+    // en ese momento el bus SPI está libre
+    if(irq_armed) {
+        irq_armed = 0;
+        irq_latched = rc522_spi_read(CommIrqReg);
+        irq_done = 1;
+    }
+}
+#endif
 
-                for (i = 0; i < n; i++) {
-                    backData[i] = RC522_ReadReg(FIFODataReg);
+// Espera a que CommIrqReg active alguno de los bits de irqEn (los mismos
+// que se habilitaron en CommIEnReg). Devuelve CommIrqReg, 0 si no llega
+// antes de timeoutUs.
+static uint8_t rc522_wait_irq(uint8_t irqEn, uint32_t timeoutUs) {
+    uint8_t n;
+    uint32_t deadline = deadline_us(timeoutUs);
+    irqEn &= 0x7F;
+    
+#if RC522_USE_IRQ
+    while(1) {
+        __disable_irq();
+        irq_done = 0;
+        irq_armed = 1;
+        
+        if(!(GPIOA->IDR & (1 << 0))) {
+            // La línea ya está activa: no habrá flanco, leer directamente
+            irq_armed = 0;
+            __enable_irq();
+            n = rc522_spi_read(CommIrqReg);
+        } else {
+            // WFI despierta aunque PRIMASK esté activo; la ISR corre al
+            // rehabilitar interrupciones, sin carrera entre el test y el WFI.
+            // SysTick despierta al menos cada 1 ms para revisar el plazo
+            while(!irq_done) {
+                if(deadline_expired(deadline, micros())) {
+                    irq_armed = 0;
+                    __enable_irq();
+                    return 0;
                 }
+                __WFI();
+                __enable_irq();
+                __disable_irq();
             }
-        } else {
-            status = MI_ERR;
+            __enable_irq();
+            n = irq_latched;
         }
-    } else {
-        status = MI_ERR;
+        
+        if(n & irqEn) {
+            return n;
+        }
+        
+        // Bits sin interés: limpiarlos para liberar la línea y re-armar
+        rc522_spi_write(CommIrqReg, n & 0x7F);
     }
-
-    return status;
+#else
+    do {
+        n = RC522_ReadReg(CommIrqReg);
+        if(n & irqEn) {
+            return n;
+        }
+    } while(!deadline_expired(deadline, micros()));
+    return 0;
+#endif
 }
 
-// =================== TRANSCEIVE (Legacy wrapper) ==================
-/**
- * Legacy wrapper for backward compatibility with existing code
- */
-int RC522_Transceive(uint8_t *send, uint8_t sendLen, uint8_t *back,
-                     uint8_t *backLen, uint8_t validBits) {
+// =================== RC522 INIT ==================
+void RC522_Init(void) {
+    // Tablas CRC_A en RAM (DWT y SysTick ya activos: Timing_Init)
+    CRC_A_Init();
     
-    // Check if we're in authenticated mode (MFCrypto1On bit)
-    uint8_t status2 = RC522_ReadReg(Status2Reg);
-    uint8_t isAuthenticated = (status2 & 0x08) ? 1 : 0;
+    // 1. Soft Reset: termina cuando el RC522 borra PowerDown (CommandReg
+    // bit 4) tras arrancar el oscilador
+    RC522_WriteReg(CommandReg, PCD_SoftReset);
+    shadow_invalidate();
+    uint32_t deadline = millis() + RC522_RESET_TIMEOUT_MS;
+    do {
+        delay_us(100);
+    } while((rc522_spi_read(CommandReg) & 0x10) &&
+            !deadline_expired(deadline, millis()));
     
-    // CRITICAL: Only call PCD_Idle if NOT authenticated
-    // PCD_Idle destroys the authentication session
-    if(!isAuthenticated) {
-        RC522_WriteReg(CommandReg, PCD_Idle);
-    }
+    // 2. Clear FIFO e interrupciones
+    RC522_WriteReg(FIFOLevelReg, 0x80);
+    RC522_WriteReg(CommIrqReg, 0x7F);
     
-    RC522_WriteReg(FIFOLevelReg, 0x80);  // Clear FIFO
-    RC522_WriteReg(CommIrqReg, 0x7F);    // Clear all interrupts
+    // 3. Timer configuration (TAuto=1, 15 ms)
+    rc522_set_timer(&timer_default);
     
-    // Fill FIFO with data to send
-    for(uint8_t i = 0; i < sendLen; i++) {
-        RC522_WriteReg(FIFODataReg, send[i]);
-    }
+    // 3b. Sin CRC hardware por defecto (106 kBd)
+    rc522_set_crc(RC522_CRC_NONE);
+    
+    // 4. Modulaci�n ASK 100%
+    RC522_WriteReg(TxASKReg, 0x40);
     
-    // Configure BitFramingReg with valid bits (without 0x80)
-    uint8_t bitframing = validBits & 0x07;
-    RC522_WriteReg(BitFramingReg, bitframing);
+    // 5. Modo config
+    RC522_WriteReg(ModeReg, 0x3D);
     
-    // Start transceive
-    RC522_WriteReg(CommandReg, PCD_Transceive);
+    // 6. Configurar RxGain - M�XIMA SENSIBILIDAD
+    RC522_WriteReg(RFCfgReg, 0x7F);
     
-    // SET StartSend bit AFTER starting command
-    RC522_SetBitMask(BitFramingReg, 0x80);
+    // 7. Línea IRQ en push-pull (activa en bajo con IRqInv en CommIEnReg)
+    RC522_WriteReg(DivIEnReg, 0x80);
     
-    // Wait for completion
-    uint32_t timeout = 100000;
-    uint8_t irq;
-    while(timeout--) {
-        irq = RC522_ReadReg(CommIrqReg);
-        
-        // Check if received data (RxIRq=0x20) or timeout (IdleIRq=0x10)
-        if(irq & 0x30) break;
-        
-        delay_us(10);
+    // 8. Anticolisión: ValuesAfterColl=0, bits tras la colisión a cero
+    RC522_WriteReg(CollReg, 0x00);
+    
+    // 9. Inicializar CommandReg
+    RC522_WriteReg(CommandReg, PCD_Idle);
+}
+
+// =================== TRANSCEIVE ENGINE ===========
+// Un único camino para todas las tramas. Cada tipo de comando tiene un
+// descriptor constante con su configuración; solo se escriben los
+// registros que cambian respecto a la trama anterior (caché de registros).
+typedef struct {
+    uint8_t command;                // PCD_Transceive / PCD_MFAuthent
+    uint8_t irqEn;                  // Bits de CommIEnReg (los que terminan la espera)
+    uint8_t waitIRq;                // Bits que indican fin correcto
+    uint8_t errMask;                // Bits de ErrorReg que invalidan la trama
+    uint8_t txLastBits;             // Bits válidos del último byte enviado
+    uint8_t crc;                    // Política RC522_CRC_*
+    const rc522_timer_t *timer;     // Timeout (TimerIRq)
+} rc522_cmd_t;
+
+// ErrorReg: 0x01 ProtocolErr, 0x02 ParityErr, 0x04 CRCErr, 0x08 CollErr,
+// 0x10 BufferOvfl. CRCErr solo se comprueba si el RC522 verifica el CRC.
+// IRQ: 0x31 = RxIRq | IdleIRq | TimerIRq, 0x13 = IdleIRq | ErrIRq | TimerIRq
+static const rc522_cmd_t cmd_table[RC522_CMD_COUNT] = {
+    //                       command         irqEn wait  err   bits CRC                           timer
+    [RC522_CMD_TRANSCEIVE] = { PCD_Transceive, 0x31, 0x30, 0x1B, 0, RC522_CRC_NONE,                &timer_default },
+    [RC522_CMD_REQA]       = { PCD_Transceive, 0x31, 0x30, 0x13, 7, RC522_CRC_NONE,                &timer_reqa    },
+    [RC522_CMD_ANTICOLL]   = { PCD_Transceive, 0x31, 0x30, 0x13, 0, RC522_CRC_NONE,                &timer_default },
+    [RC522_CMD_SELECT]     = { PCD_Transceive, 0x31, 0x30, 0x1B, 0, RC522_CRC_TX | RC522_CRC_RX,  &timer_default },
+    [RC522_CMD_AUTH]       = { PCD_MFAuthent,  0x13, 0x10, 0x1B, 0, RC522_CRC_NONE,                &timer_default },
+    [RC522_CMD_READ]       = { PCD_Transceive, 0x31, 0x30, 0x1B, 0, RC522_CRC_TX | RC522_CRC_RX,  &timer_default },
+    [RC522_CMD_WRITE]      = { PCD_Transceive, 0x31, 0x30, 0x1B, 0, RC522_CRC_TX,                 &timer_default },
+    [RC522_CMD_HALT]       = { PCD_Transceive, 0x31, 0x30, 0x1B, 0, RC522_CRC_TX,                 &timer_reqa    },
+};
+
+// ErrorReg de la última trama (0 si no hubo ErrIRq y no se leyó)
+static uint8_t last_error;
+
+/**
+ * Ejecuta una trama según su descriptor.
+ * framing: valor de BitFramingReg (RxAlign en [6:4], TxLastBits en [2:0])
+ * backLen: entrada = capacidad de back, salida = bytes recibidos
+ * rxBits:  bits válidos del último byte recibido (0 = completo), opcional
+ * Devuelve MI_OK, MI_NOTAGERR (sin respuesta) o MI_ERR
+ */
+// Fase 1: configurar y lanzar la trama; el RC522 la transmite y espera
+// la respuesta por su cuenta
+static void rc522_start(const rc522_cmd_t *d, uint8_t framing,
+                        const uint8_t *send, uint8_t sendLen) {
+    last_error = 0;
+    
+    // 1. Configuración por comando (en caché: normalmente no cuesta SPI)
+    rc522_set_timer(d->timer);
+    rc522_set_crc(d->crc);
+    RC522_WriteReg(CommIEnReg, 0x80 | d->irqEn);   // IRQ activo en bajo (IRqInv)
+    
+    // 2. Parar cualquier comando en curso, limpiar IRQs y FIFO
+    // (Idle no borra MFCrypto1On: la sesión autenticada se mantiene)
+    RC522_WriteReg(CommandReg, PCD_Idle);
+    RC522_WriteReg(CommIrqReg, 0x7F);
+    RC522_WriteReg(FIFOLevelReg, 0x80);
+    
+    // 3. Datos al FIFO en una sola ráfaga
+    RC522_WriteFIFO(send, sendLen);
+    
+    // 4. Ejecutar: en Transceive, StartSend junto con los bits de trama
+    RC522_WriteReg(CommandReg, d->command);
+    if(d->command == PCD_Transceive) {
+        RC522_WriteReg(BitFramingReg, 0x80 | framing);
+    }
+}
+
+// Fase 2: esperar el fin de la trama y recoger la respuesta
+static int rc522_finish(const rc522_cmd_t *d, uint8_t framing,
+                        uint8_t *back, uint8_t *backLen, uint8_t *rxBits) {
+    uint8_t n;
+    uint8_t errMask = d->errMask;
+    
+    if(crc_offload && (d->crc & RC522_CRC_RX)) {
+        errMask |= 0x04;                            // CRC verificado por el RC522
     }
     
-    RC522_ClearBitMask(BitFramingReg, 0x80);  // Clear StartSend
+    // 5. Esperar en la línea IRQ (si ya llegó, la línea sigue activa)
+    n = rc522_wait_irq(d->irqEn, d->timer->guardUs);
     
-    if(timeout == 0) {
-        return -1;  // Timeout
+    if(d->command == PCD_Transceive) {
+        RC522_WriteReg(BitFramingReg, framing);    // Clear StartSend
     }
     
-    // Check errors
-    uint8_t error = RC522_ReadReg(ErrorReg);
-    // Ignore CollErr (0x08) which can occur during anti-collision
-    // Also ignore CRCErr (0x04) in authenticated mode - RC522 handles it
-    uint8_t errorMask = isAuthenticated ? 0x1B : 0x13;
-    if(error & errorMask) {
-        return -1;
+    if(!(n & d->waitIRq)) {
+        return (n & 0x01) ? MI_NOTAGERR : MI_ERR;
     }
     
-    // Read data from FIFO
-    uint8_t n = RC522_ReadReg(FIFOLevelReg);
+    // 6. ErrorReg solo si CommIrqReg marcó ErrIRq
+    if(n & 0x02) {
+        last_error = RC522_ReadReg(ErrorReg);
+        if(last_error & errMask) {
+            return MI_ERR;
+        }
+    }
     
-    // If no data, still valid for some commands
-    if(n == 0) {
-        *backLen = 0;
-        return 0;
+    if(d->command != PCD_Transceive) {
+        if(backLen) {
+            *backLen = 0;
+        }
+        return MI_OK;
     }
     
+    // 7. Respuesta
+    n = RC522_ReadReg(FIFOLevelReg);
+    if(n > RC522_FIFO_SIZE) {
+        rc522_link_error();             // Nivel imposible: enlace SPI corrupto
+        return MI_ERR;
+    }
     if(n > *backLen) {
         n = *backLen;
     }
+    RC522_ReadFIFO(back, n);
+    *backLen = n;
     
-    for(uint8_t i = 0; i < n; i++) {
-        back[i] = RC522_ReadReg(FIFODataReg);
+    if(rxBits) {
+        *rxBits = RC522_ReadReg(ControlReg) & 0x07;
     }
     
-    *backLen = n;
-    return 0;
+    return MI_OK;
 }
 
-// =================== TRANSCEIVE (ENCRYPTED) ======
-// Versión especial que NO rompe la sesión autenticada
-int RC522_TransceiveEncrypted(uint8_t *send, uint8_t sendLen, uint8_t *back,
-                               uint8_t *backLen, uint8_t validBits) {
-    
-    // Debug: verificar estado inicial
-    uint8_t status2_before = RC522_ReadReg(Status2Reg);
-    char dbg[128];
-    sprintf(dbg, "    [TransEnc] Status2 inicial: 0x%02X (Crypto=%s)\r\n", 
-            status2_before, (status2_before & 0x08) ? "ON" : "OFF");
-    USART_SendString(dbg);
-    
-    // NO llamar a PCD_Idle - esto destruye la autenticación
-    // NO limpiar FIFO todavía - puede contener datos de autenticación
-    RC522_WriteReg(CommIrqReg, 0x7F);    // Clear todas las interrupciones
-    
-    sprintf(dbg, "    [TransEnc] Comando: 0x%02X 0x%02X\r\n", send[0], send[1]);
-    USART_SendString(dbg);
-    
-    // Clear FIFO AHORA
-    RC522_WriteReg(FIFOLevelReg, 0x80);
-    
-    // Llenar FIFO con datos a enviar (sin CRC - el RC522 lo hace automático)
-    for(uint8_t i = 0; i < sendLen; i++) {
-        RC522_WriteReg(FIFODataReg, send[i]);
+static int rc522_execute(const rc522_cmd_t *d, uint8_t framing,
+                         const uint8_t *send, uint8_t sendLen,
+                         uint8_t *back, uint8_t *backLen, uint8_t *rxBits) {
+    rc522_start(d, framing, send, sendLen);
+    return rc522_finish(d, framing, back, backLen, rxBits);
+}
+
+int RC522_Execute(RC522_Cmd cmd, const uint8_t *send, uint8_t sendLen,
+                  uint8_t *back, uint8_t *backLen, uint8_t *rxBits) {
+    if(cmd >= RC522_CMD_COUNT) {
+        return MI_ERR;
+    }
+    const rc522_cmd_t *d = &cmd_table[cmd];
+    return rc522_execute(d, d->txLastBits, send, sendLen, back, backLen, rxBits);
+}
+
+// Respuestas más largas que el FIFO de 64 bytes (p. ej. FAST_READ): se
+// vacía el FIFO por ráfagas mientras la tarjeta sigue transmitiendo. Un
+// byte tarda ~85 us en el aire a 106 kbit/s y una ráfaga de 64 bytes por
+// SPI unas decenas de us, así que el FIFO nunca llega a desbordar.
+// backLen: entrada = capacidad de back, salida = bytes recibidos
+int RC522_ExecuteLong(RC522_Cmd cmd, const uint8_t *send, uint8_t sendLen,
+                      uint8_t *back, uint16_t *backLen) {
+    const rc522_cmd_t *d;
+    uint16_t got = 0;
+    uint8_t irq, level;
+    uint8_t errMask;
+    
+    if(cmd >= RC522_CMD_COUNT) {
+        return MI_ERR;
+    }
+    d = &cmd_table[cmd];
+    errMask = d->errMask;
+    if(crc_offload && (d->crc & RC522_CRC_RX)) {
+        errMask |= 0x04;
     }
     
-    // BitFramingReg: 0x00 para bytes completos, 0x80 se setea después
-    RC522_WriteReg(BitFramingReg, 0x00);
-    
-    // Iniciar transceive
-    RC522_WriteReg(CommandReg, PCD_Transceive);
+    rc522_start(d, d->txLastBits, send, sendLen);
     
-    // SET StartSend bit
-    RC522_SetBitMask(BitFramingReg, 0x80);
+    // Plazo: timeout del timer + duración de la respuesta esperada
+    uint32_t deadline = deadline_us(d->timer->guardUs +
+                                    (uint32_t)*backLen * RC522_RX_US_PER_BYTE);
+    int result = MI_OK;
     
-    // Esperar a que termine (timeout más corto)
-    uint32_t timeout = 50000;
-    uint8_t irq;
-    uint32_t loops = 0;
-    while(timeout--) {
+    while(1) {
+        // CommIrqReg antes que el nivel: si la trama ya terminó, el nivel
+        // leído después incluye todos sus bytes
         irq = RC522_ReadReg(CommIrqReg);
+        level = RC522_ReadReg(FIFOLevelReg) & 0x7F;
         
-        // Terminar cuando reciba datos O timeout
-        if(irq & 0x30) break;  // RxIRq(0x20) o IdleIRq(0x10)
+        if(level > 0) {
+            if(level > *backLen - got) {
+                result = MI_ERR;            // Respuesta mayor que el buffer
+                break;
+            }
+            RC522_ReadFIFO(&back[got], level);
+            got += level;
+        }
         
-        loops++;
-        delay_us(5);
-    }
-    
-    sprintf(dbg, "    [TransEnc] Esperó %u loops, IRQ final: 0x%02X\r\n", loops, irq);
-    USART_SendString(dbg);
-    
-    RC522_ClearBitMask(BitFramingReg, 0x80);  // Clear StartSend
-    
-    if(timeout == 0) {
-        USART_SendString("    [TransEnc] ✗ TIMEOUT\r\n");
-        return -1;
+        if(irq & d->waitIRq) {
+            break;
+        }
+        if((irq & 0x01) && got == 0) {
+            result = MI_NOTAGERR;           // TimerIRq: sin respuesta
+            break;
+        }
+        if(deadline_expired(deadline, micros())) {
+            result = MI_ERR;
+            break;
+        }
     }
     
-    // Verificar errores ANTES de leer FIFO
-    uint8_t error = RC522_ReadReg(ErrorReg);
-    sprintf(dbg, "    [TransEnc] ErrorReg: 0x%02X ", error);
-    USART_SendString(dbg);
+    RC522_WriteReg(BitFramingReg, d->txLastBits);  // Clear StartSend
     
-    // Decodificar bits de error
-    if(error & 0x01) USART_SendString("[ProtocolErr] ");
-    if(error & 0x02) USART_SendString("[ParityErr] ");
-    if(error & 0x04) USART_SendString("[CRCErr] ");
-    if(error & 0x08) USART_SendString("[CollErr] ");
-    if(error & 0x10) USART_SendString("[BufferOvfl] ");
-    USART_SendString("\r\n");
-    
-    // Para comandos encriptados, ignorar CRCErr ya que el RC522 maneja CRC internamente
-    if(error & 0x1B) {  // ProtocolErr, ParityErr, BufferOvfl, CollErr
-        USART_SendString("    [TransEnc] ✗ Error crítico\r\n");
-        return -1;
+    if(result == MI_OK && (irq & 0x02)) {
+        last_error = RC522_ReadReg(ErrorReg);
+        if(last_error & errMask) {
+            result = MI_ERR;
+        }
     }
     
-    // Leer datos del FIFO
-    uint8_t n = RC522_ReadReg(FIFOLevelReg);
-    sprintf(dbg, "    [TransEnc] FIFO Level: %d bytes\r\n", n);
-    USART_SendString(dbg);
-    
-    if(n == 0) {
-        *backLen = 0;
-        USART_SendString("    [TransEnc] ⚠ FIFO vacío - tarjeta no respondió\r\n");
-        return -1;  // Cambiar a error en vez de éxito
+    *backLen = got;
+    return result;
+}
+
+// Ejecución en dos fases: entre RC522_Start y RC522_Finish el MCU queda
+// libre (p. ej. para formatear el bloque anterior) mientras el RC522
+// transmite y recibe. No se debe acceder al RC522 entre ambas llamadas.
+int RC522_Start(RC522_Cmd cmd, const uint8_t *send, uint8_t sendLen) {
+    if(cmd >= RC522_CMD_COUNT) {
+        return MI_ERR;
     }
-    
-    // Leer TODOS los bytes del FIFO (incluye datos + CRC si hay)
-    uint8_t actualLen = (n < *backLen) ? n : *backLen;
-    for(uint8_t i = 0; i < actualLen; i++) {
-        back[i] = RC522_ReadReg(FIFODataReg);
+    const rc522_cmd_t *d = &cmd_table[cmd];
+    rc522_start(d, d->txLastBits, send, sendLen);
+    return MI_OK;
+}
+
+int RC522_Finish(RC522_Cmd cmd, uint8_t *back, uint8_t *backLen, uint8_t *rxBits) {
+    if(cmd >= RC522_CMD_COUNT) {
+        return MI_ERR;
     }
-    
-    *backLen = actualLen;
-    
-    // Verificar estado crypto después
-    uint8_t status2_after = RC522_ReadReg(Status2Reg);
-    sprintf(dbg, "    [TransEnc] Status2 final: 0x%02X (Crypto=%s), Leídos: %d bytes\r\n", 
-            status2_after, (status2_after & 0x08) ? "ON" : "OFF", actualLen);
-    USART_SendString(dbg);
-    
-    return 0;
+    const rc522_cmd_t *d = &cmd_table[cmd];
+    return rc522_finish(d, d->txLastBits, back, backLen, rxBits);
 }
 
 // =================== CRC CALCULATION =============
-void RC522_CalculateCRC(uint8_t *data, uint8_t len, uint8_t *result) {
-    RC522_WriteReg(CommandReg, PCD_Idle);
-    RC522_WriteReg(FIFOLevelReg, 0x80);  // Clear FIFO
-    
-    // Escribir datos al FIFO
-    for(uint8_t i = 0; i < len; i++) {
-        RC522_WriteReg(FIFODataReg, data[i]);
-    }
-    
-    // Iniciar cálculo CRC
-    RC522_WriteReg(CommandReg, 0x03);  // CalcCRC command
-    
-    // Esperar a que termine
-    uint32_t timeout = 5000;
-    uint8_t n;
-    while(timeout--) {
-        n = RC522_ReadReg(CommIrqReg);
-        if(n & 0x04) break;  // CRCIRq bit
-        delay_us(10);
-    }
-    
-    // Leer resultado (little-endian)
-    result[0] = RC522_ReadReg(CRCResultRegL);
-    result[1] = RC522_ReadReg(CRCResultRegH);
+// CRC_A en el MCU (crc_a.c) en vez del comando CalcCRC del RC522, que
+// costaba decenas de transacciones SPI por trama y pasaba el RC522 a Idle
+// en medio de una sesión autenticada.
+void RC522_CalculateCRC(uint8_t *data, uint16_t len, uint8_t *result) {
+    CRC_A_Calculate(data, len, result);
 }
 
-// =================== REQA ========================
-int RC522_RequestA(uint8_t *atqa, uint8_t *atqaLen) {
-    uint8_t cmd = PICC_REQA;        // 0x26
+// =================== REQA / WUPA =================
+// REQA solo lo contestan las tarjetas en IDLE; WUPA también las que están
+// en HALT. Ambos usan la misma trama corta de 7 bits.
+// ATQA del último REQA/WUPA contestado (se copia en RC522_Uid al seleccionar)
+static uint8_t last_atqa[2];
+
+static int rc522_request(uint8_t code, uint8_t *atqa, uint8_t *atqaLen) {
+    uint8_t cmd = code;
     uint8_t back[4] = {0};
     uint8_t blen = sizeof(back);
     
-    // REQA se env�a con 7 bits v�lidos
-    int result = RC522_Transceive(&cmd, 1, back, &blen, 7);
+    uint32_t start = Timing_Cycles();
+    uint32_t frames = RC522_GetStats()->spiFrames;
+    
+    // REQA se env�a con 7 bits v�lidos, timeout de 1 ms: sin tarjeta el
+    // TimerIRq termina el sondeo
+    int result = RC522_Execute(RC522_CMD_REQA, &cmd, 1, back, &blen, NULL);
     
-    if(result == 0 && blen == 2) {  // Debe recibir exactamente 2 bytes
-        atqa[0] = back[0];
-        atqa[1] = back[1];
+    if(result == MI_OK && blen == 2) {  // Debe recibir exactamente 2 bytes
+        atqa[0] = last_atqa[0] = back[0];
+        atqa[1] = last_atqa[1] = back[1];
         *atqaLen = 2;
         return 0;
     }
     
+    // Sondeo sin tarjeta: registrar latencia y coste SPI
+    uint32_t cycles = Timing_Cycles() - start;
+    poll_stats.noCardPolls++;
+    poll_stats.lastCycles = cycles;
+    if(cycles > poll_stats.maxCycles) {
+        poll_stats.maxCycles = cycles;
+    }
+    poll_stats.lastSpiFrames = RC522_GetStats()->spiFrames - frames;
+    
     return -1;
 }
 
-// =================== ANTICOLLISION ===============
-int RC522_AnticollCL1(uint8_t *uid, uint8_t *uidLen) {
-    uint8_t cmd[2] = {PICC_ANTICOLL_CL1, 0x20};  // 0x93, 0x20 (SEL, NVB)
-    uint8_t back[10] = {0};
+int RC522_RequestA(uint8_t *atqa, uint8_t *atqaLen) {
+    return rc522_request(PICC_REQA, atqa, atqaLen);
+}
+
+int RC522_WakeupA(uint8_t *atqa, uint8_t *atqaLen) {
+    return rc522_request(PICC_WUPA, atqa, atqaLen);
+}
+
+// =================== HLTA ========================
+// La tarjeta no responde a HLTA: el éxito es el timeout (1 ms). Cualquier
+// respuesta es un NAK. Con Crypto1 activo la trama sale cifrada, que es lo
+// que espera una MIFARE Classic autenticada.
+int RC522_HaltA(void) {
+    uint8_t cmd[4] = {PICC_HLTA, 0x00};
+    uint8_t back[1];
     uint8_t blen = sizeof(back);
-    int result;
     
-    // Anti-colisi�n - se env�a con 0 bits v�lidos (frame de control)
-    result = RC522_Transceive(cmd, 2, back, &blen, 0);
+    uint8_t len = RC522_AppendCRC(cmd, 2);
+    int result = RC522_Execute(RC522_CMD_HALT, cmd, len, back, &blen, NULL);
     
-    if(result == 0 && blen >= 5) {
-        // Los primeros 4 bytes son el UID, el quinto es el checksum
-        for(uint8_t i = 0; i < 4; i++) {
-            uid[i] = back[i];
+    return (result == MI_NOTAGERR) ? 0 : -1;
+}
+
+// Apaga y enciende el campo RF: todas las tarjetas (también en HALT)
+// se reinician y vuelven a IDLE
+void RC522_FieldReset(void) {
+    RC522_ClearBitMask(TxControlReg, 0x03);
+    delay_ms(RC522_FIELD_RESET_MS);
+    RC522_SetBitMask(TxControlReg, 0x03);
+    delay_ms(RC522_FIELD_RESET_MS);     // Arranque de las tarjetas
+}
+
+// =================== ANTICOLISIÓN ================
+// Anticolisión orientada a bit (ISO 14443-3, 6.5.3). Se envían los bits
+// del UID ya conocidos (NVB) y la respuesta llega alineada detrás de ellos
+// (RxAlign = TxLastBits). Si dos tarjetas difieren, CollReg da la posición
+// del primer bit en conflicto: se elige la rama '1' y se repite. Sin
+// colisión un nivel cuesta una sola trama.
+// uidcl: 4 bytes del nivel (o CT + 3 bytes) + BCC
+static int rc522_anticoll_level(uint8_t sel, uint8_t *uidcl) {
+    uint8_t buf[7] = {0};          // SEL, NVB, UID(4), BCC
+    uint8_t back[5];
+    uint8_t known = 0;             // Bits de UID+BCC resueltos (0..40)
+    
+    buf[0] = sel;
+    
+    while(known < 40) {
+        uint8_t bytes = known >> 3;
+        uint8_t bits = known & 0x07;
+        uint8_t idx = 2 + bytes;
+        uint8_t blen = 5 - bytes;
+        
+        buf[1] = (uint8_t)(((2 + bytes) << 4) | bits);    // NVB
+        
+        int result = rc522_execute(&cmd_table[RC522_CMD_ANTICOLL],
+                                   (uint8_t)((bits << 4) | bits),
+                                   buf, idx + (bits ? 1 : 0),
+                                   back, &blen, NULL);
+        if(result != MI_OK || blen == 0) {
+            return -1;
         }
-        uid[4] = back[4];  // BCC (checksum)
-        *uidLen = 5;
-        return 0;
+        
+        // El primer byte recibido completa el byte parcial enviado
+        uint8_t keep = (uint8_t)((1u << bits) - 1);
+        buf[idx] = (uint8_t)((buf[idx] & keep) | (back[0] & ~keep));
+        for(uint8_t i = 1; i < blen && idx + i < sizeof(buf); i++) {
+            buf[idx + i] = back[i];
+        }
+        
+        if(!(last_error & 0x08)) {
+            // Sin colisión: deben haber llegado todos los bytes del nivel
+            if(blen != 5 - bytes) {
+                return -1;
+            }
+            break;
+        }
+        
+        // CollPos (1..32, 0 = 32) cuenta desde el bit 0 del primer byte
+        // recibido, que con RxAlign es el byte parcial
+        uint8_t coll = RC522_ReadReg(CollReg);
+        if(coll & 0x20) {
+            return -1;                 // CollPosNotValid
+        }
+        uint8_t pos = coll & 0x1F;
+        if(pos == 0) {
+            pos = 32;
+        }
+        uint8_t collBit = (uint8_t)((bytes << 3) + pos);
+        if(collBit <= known || collBit > 40) {
+            return -1;
+        }
+        
+        known = collBit;
+        buf[2 + ((collBit - 1) >> 3)] |= (uint8_t)(1u << ((collBit - 1) & 0x07));
     }
     
-    return -1;
+    // BCC = XOR de los 4 bytes del nivel
+    if((buf[2] ^ buf[3] ^ buf[4] ^ buf[5]) != buf[6]) {
+        return -1;
+    }
+    
+    memcpy(uidcl, &buf[2], 5);
+    return 0;
 }
 
 // =================== SELECT ======================
-int RC522_Select(uint8_t *uid) {
+static const uint8_t cascade_sel[3] = {PICC_SELECT_CL1, PICC_SELECT_CL2, PICC_SELECT_CL3};
+
+// Última tarjeta seleccionada: UID+BCC y SAK de cada nivel, para volver a
+// seleccionarla sin anticolisión (ver RC522_Reselect)
+static struct {
+    uint8_t levels;                // 0 = ninguna tarjeta recordada
+    uint8_t uidcl[3][5];
+    uint8_t sak[3];
+} last_card;
+
+// Añade al UID los bytes de un nivel: 4 si es el último, 3 tras el CT
+static void uid_append(RC522_Uid *card, const uint8_t *uidcl, uint8_t sak) {
+    if(sak & PICC_SAK_CASCADE) {
+        memcpy(&card->uid[card->size], &uidcl[1], 3);
+        card->size += 3;
+    } else {
+        memcpy(&card->uid[card->size], uidcl, 4);
+        card->size += 4;
+        card->sak = sak;
+    }
+}
+
+static int rc522_select_level(uint8_t sel, const uint8_t *uidcl, uint8_t *sak) {
     uint8_t cmd[9];
-    uint8_t back[10] = {0};
+    uint8_t back[3] = {0};
     uint8_t blen = sizeof(back);
     
-    // Comando SELECT: SEL (0x93) + NVB (0x70 = 7 bytes) + UID(4) + BCC(1)
-    cmd[0] = PICC_SELECT_CL1;  // 0x93
-    cmd[1] = 0x70;             // NVB: 7 bytes de datos (UID + BCC)
+    // SEL + NVB (0x70 = 7 bytes: SEL, NVB, UID(4), BCC)
+    cmd[0] = sel;
+    cmd[1] = 0x70;
+    memcpy(&cmd[2], uidcl, 5);
+    
+    // CRC del SELECT: en software o, en modo offload, lo añade el RC522
+    uint8_t len = RC522_AppendCRC(cmd, 7);
+    
+    // El SAK también lleva CRC: en modo offload el RC522 lo comprueba
+    int result = RC522_Execute(RC522_CMD_SELECT, cmd, len, back, &blen, NULL);
+    if(result != MI_OK || blen < 1) {
+        return -1;
+    }
+    
+    if(!crc_offload) {
+        uint8_t crc[2];
+        if(blen != 3) {
+            return -1;
+        }
+        RC522_CalculateCRC(back, 1, crc);
+        if(crc[0] != back[1] || crc[1] != back[2]) {
+            return -1;
+        }
+    }
     
-    // Copiar UID (4 bytes) y BCC (1 byte)
-    for(uint8_t i = 0; i < 5; i++) {
-        cmd[2 + i] = uid[i];
+    *sak = back[0];
+    return 0;
+}
+
+// Cascada completa: CL1 -> CL2 -> CL3 mientras el SAK tenga el bit 0x04.
+// Cada nivel incompleto empieza por el Cascade Tag 0x88, que no forma
+// parte del UID. Mínimo de tramas: 2 por nivel si no hay colisiones
+int RC522_SelectCard(RC522_Uid *card) {
+    uint8_t uidcl[5];
+    uint8_t sak;
+    
+    card->size = 0;
+    memcpy(card->atqa, last_atqa, 2);
+    last_card.levels = 0;
+    
+    for(uint8_t level = 0; level < 3; level++) {
+        if(rc522_anticoll_level(cascade_sel[level], uidcl) != 0) {
+            return -1;
+        }
+        if(rc522_select_level(cascade_sel[level], uidcl, &sak) != 0) {
+            return -1;
+        }
+        if((sak & PICC_SAK_CASCADE) && uidcl[0] != PICC_CASCADE_TAG) {
+            return -1;
+        }
+        
+        memcpy(last_card.uidcl[level], uidcl, 5);
+        last_card.sak[level] = sak;
+        uid_append(card, uidcl, sak);
+        
+        if(!(sak & PICC_SAK_CASCADE)) {
+            last_card.levels = level + 1;
+            return 0;
+        }
     }
     
-    // Calcular CRC para el SELECT
-    uint8_t crcBuf[2];
-    RC522_CalculateCRC(cmd, 7, crcBuf);
-    cmd[7] = crcBuf[0];
-    cmd[8] = crcBuf[1];
+    return -1;                     // Cascada de más de 3 niveles
+}
+
+// =================== RESELECCIÓN RÁPIDA ==========
+// Tras HLTA o StopCrypto1 la misma tarjeta se recupera con WUPA + SELECT
+// del UID recordado: una trama de anticolisión menos por nivel. El SAK
+// debe coincidir con el de la selección original.
+int RC522_Reselect(RC522_Uid *card) {
+    uint8_t atqa[2], atqaLen;
+    uint8_t sak;
+    
+    if(last_card.levels == 0) {
+        return -1;
+    }
+    if(RC522_WakeupA(atqa, &atqaLen) != 0) {
+        return -1;
+    }
     
-    // sprintf(tbuf, "SELECT CRC: %02X %02X\r\n", cmd[7], cmd[8]);
-    // USART_SendString(tbuf);
+    card->size = 0;
+    memcpy(card->atqa, atqa, 2);
+    for(uint8_t level = 0; level < last_card.levels; level++) {
+        if(rc522_select_level(cascade_sel[level], last_card.uidcl[level], &sak) != 0 ||
+           sak != last_card.sak[level]) {
+            return -1;
+        }
+        uid_append(card, last_card.uidcl[level], sak);
+    }
     
-    int result = RC522_Transceive(cmd, 9, back, &blen, 0);
+    return 0;
+}
+
+// Niveles de cascada de un UID completo: CT + 3 bytes en los niveles
+// intermedios y 4 bytes en el último, cada uno con su BCC
+static uint8_t uid_levels(const RC522_Uid *card, uint8_t uidcl[3][5]) {
+    uint8_t levels = (card->size == 4) ? 1 : (card->size == 7) ? 2 :
+                     (card->size == 10) ? 3 : 0;
+    uint8_t pos = 0;
+    
+    for(uint8_t level = 0; level < levels; level++) {
+        if(level < levels - 1) {
+            uidcl[level][0] = PICC_CASCADE_TAG;
+            memcpy(&uidcl[level][1], &card->uid[pos], 3);
+            pos += 3;
+        } else {
+            memcpy(uidcl[level], &card->uid[pos], 4);
+            pos += 4;
+        }
+        uidcl[level][4] = uidcl[level][0] ^ uidcl[level][1] ^
+                          uidcl[level][2] ^ uidcl[level][3];
+    }
+    return levels;
+}
+
+// WUPA/REQA + SELECT de un UID conocido (sondeo de presencia). Si el
+// SELECT falla se repite con otra petición: la tarjeta pudo pasar de READY
+// a IDLE por una petición que contestaron otras tarjetas
+static int select_uid(const RC522_Uid *card, int (*request)(uint8_t *, uint8_t *)) {
+    uint8_t uidcl[3][5];
+    uint8_t atqa[2], atqaLen;
+    uint8_t sak;
+    uint8_t levels = uid_levels(card, uidcl);
+    
+    if(levels == 0) {
+        return -1;
+    }
     
-    // sprintf(tbuf, "SELECT result=%d, backLen=%u\r\n", result, blen);
-    // USART_SendString(tbuf);
+    for(uint8_t attempt = 0; attempt < 2; attempt++) {
+        if(request(atqa, &atqaLen) != 0) {
+            continue;
+        }
+        
+        uint8_t level;
+        for(level = 0; level < levels; level++) {
+            if(rc522_select_level(cascade_sel[level], uidcl[level], &sak) != 0) {
+                break;
+            }
+            if((level < levels - 1) ? !(sak & PICC_SAK_CASCADE) : (sak != card->sak)) {
+                break;
+            }
+        }
+        if(level == levels) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int RC522_SelectUid(const RC522_Uid *card) {
+    return select_uid(card, RC522_WakeupA);
+}
+
+int RC522_SelectUidIdle(const RC522_Uid *card) {
+    return select_uid(card, RC522_RequestA);
+}
+
+// Reselección rápida y, si falla, anticolisión completa. Un WUPA puede
+// perderse si alguna tarjeta quedó en READY tras el SELECT fallido, por
+// eso se reintenta una vez. Puede devolver otra tarjeta: comparar el UID
+int RC522_ReselectCard(RC522_Uid *card) {
+    uint8_t atqa[2], atqaLen;
     
-    if(result == 0 && blen >= 1) {
-        // sprintf(tbuf, "SAK: 0x%02X\r\n", back[0]);
-        // USART_SendString(tbuf);
+    if(RC522_Reselect(card) == 0) {
         return 0;
     }
     
+    for(uint8_t attempt = 0; attempt < 2; attempt++) {
+        if(RC522_WakeupA(atqa, &atqaLen) == 0) {
+            return RC522_SelectCard(card);
+        }
+    }
     return -1;
 }
 
 // =================== AUTENTICAR / LEER / ESCRIBIR BLOQUE ==================
-#include <string.h>
-
 // Authenticates to a block using KeyA or KeyB
 // authMode: PICC_AUTHENT1A (0x60) or PICC_AUTHENT1B (0x61)
 // key: 6-byte key
@@ -536,29 +1227,13 @@ int RC522_Select(uint8_t *uid) {
 int RC522_Auth(uint8_t authMode, uint8_t blockAddr, uint8_t *key, uint8_t *uid) {
     uint8_t buff[12];
 
-    // DON'T call PCD_Idle here - it destroys the card session!
     // The card is already selected in main, we just need to authenticate
-    
-    RC522_WriteReg(FIFOLevelReg, 0x80); // clear FIFO
-
     buff[0] = authMode;
     buff[1] = blockAddr;
     memcpy(&buff[2], key, 6);
     memcpy(&buff[8], uid, 4);
 
-    for(uint8_t i = 0; i < 12; i++) {
-        RC522_WriteReg(FIFODataReg, buff[i]);
-    }
-
-    RC522_WriteReg(CommandReg, PCD_MFAuthent);
-
-    // Wait for authentication to complete
-    uint32_t timeout = 5000;
-    while(timeout--) {
-        uint8_t n = RC522_ReadReg(CommIrqReg);
-        if(n & 0x10) break; // IdleIRq
-        delay_us(10);
-    }
+    RC522_Execute(RC522_CMD_AUTH, buff, 12, NULL, NULL, NULL);
 
     // Check Status2Reg for MFCrypto1On bit
     uint8_t status2 = RC522_ReadReg(Status2Reg);
@@ -574,73 +1249,7 @@ int RC522_Auth(uint8_t authMode, uint8_t blockAddr, uint8_t *key, uint8_t *uid)
 
 void RC522_StopCrypto1(void) {
     // Clear MFCrypto1On bit
-    RC522_ClearBitMask(Status2Reg, 0x08);
-}
-
-// Read 16 bytes from blockAddr into data[] (must be 16 bytes); uid is 4-byte UID
-// returns 0 on success, negative on error
-int RC522_ReadBlock(uint8_t blockAddr, uint8_t *data, uint8_t *uid) {
-    uint8_t keyA[6] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
-    
-    // Autenticar (SELECT debe haberse hecho antes)
-    int res = RC522_Auth(PICC_AUTHENT1A, blockAddr, keyA, uid);
-    if(res != 0) return -1; // auth failed
-
-    uint8_t cmd[2] = {0x30, blockAddr}; // READ
-    uint8_t back[18];
-    uint8_t backLen = sizeof(back);
-    res = RC522_Transceive(cmd, 2, back, &backLen, 0);
-    if(res != 0) {
-        char tbuf[96];
-        sprintf(tbuf, "RC522_ReadBlock: Transceive READ failed, res=%d, backLen=%u, ErrorReg=0x%02X\r\n", res, backLen, RC522_ReadReg(ErrorReg));
-        USART_SendString(tbuf);
-        return -2;
-    }
-    if(backLen < 16) {
-        char tbuf[64];
-        sprintf(tbuf, "RC522_ReadBlock: short read backLen=%u, FIFOLevel=0x%02X\r\n", backLen, RC522_ReadReg(FIFOLevelReg));
-        USART_SendString(tbuf);
-        return -3;
-    }
-
-    for(uint8_t i = 0; i < 16; i++) data[i] = back[i];
-
-    // Stop authentication (optional) - COMENTADO para permitir múltiples lecturas
-    // RC522_WriteReg(CommandReg, PCD_Idle);
-    return 0;
-}
-
-// Write 16 bytes from data[] into blockAddr; uid is 4-byte UID
-// returns 0 on success, negative on error
-int RC522_WriteBlock(uint8_t blockAddr, uint8_t *data, uint8_t *uid) {
-    uint8_t keyA[6] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
-    
-    // Autenticar (SELECT debe haberse hecho antes)
-    int res = RC522_Auth(PICC_AUTHENT1A, blockAddr, keyA, uid);
-    if(res != 0) return -1; // auth failed
-
-    uint8_t cmd[2] = {0xA0, blockAddr}; // WRITE
-    uint8_t ack[4];
-    uint8_t ackLen = sizeof(ack);
-    res = RC522_Transceive(cmd, 2, ack, &ackLen, 0);
-    if(res != 0) {
-        char tbuf[64];
-        sprintf(tbuf, "RC522_WriteBlock: WRITE cmd failed, res=%d, ErrorReg=0x%02X\r\n", res, RC522_ReadReg(ErrorReg));
-        USART_SendString(tbuf);
-        return -2; // write command failed
-    }
-
-    // send 16 bytes of data
-    uint8_t back[4];
-    uint8_t backLen = sizeof(back);
-    res = RC522_Transceive(data, 16, back, &backLen, 0);
-    if(res != 0) {
-        char tbuf[64];
-        sprintf(tbuf, "RC522_WriteBlock: data write failed, res=%d, ErrorReg=0x%02X\r\n", res, RC522_ReadReg(ErrorReg));
-        USART_SendString(tbuf);
-        return -3; // data write failed
-    }
-
-    RC522_WriteReg(CommandReg, PCD_Idle);
-    return 0;
+    // Los únicos bits escribibles de Status2Reg son MFCrypto1On, I2CForceHS y
+    // TempSensClear (los dos últimos nunca se activan): basta una escritura
+    RC522_WriteReg(Status2Reg, 0x00);
 }
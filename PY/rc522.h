@@ -2,6 +2,7 @@
 #define RC522_H
 
 #include <stdint.h>
+#include "timing.h"
 
 // ================= REGISTROS =================
 #define CommandReg      0x01
@@ -23,12 +24,66 @@
 #define TReloadRegL     0x2D
 #define VersionReg      0x37
 #define CommIEnReg      0x02
+#define DivIEnReg       0x03
 #define ControlReg      0x0C
+#define CollReg         0x0E
+#define TxModeReg       0x12
+#define RxModeReg       0x13
+
+// Bits de TxModeReg / RxModeReg
+#define TxCRCEn         0x80
+#define RxCRCEn         0x80
+
+// Línea IRQ del RC522 en PA0 (EXTI0). Con 0 se vuelve a leer CommIrqReg
+// en bucle, p. ej. en placas donde IRQ no está cableado
+#ifndef RC522_USE_IRQ
+#define RC522_USE_IRQ   1
+#endif
+
+// CRC_A por hardware (TxModeReg/RxModeReg) en lugar de calcularlo en el
+// MCU. Se puede cambiar en tiempo de ejecución con RC522_SetCRCOffload
+#ifndef RC522_CRC_OFFLOAD
+#define RC522_CRC_OFFLOAD   0
+#endif
+
+// Tiempos de NSS (CS) en ns y plazos del MCU
+#define RC522_CS_SETUP_NS       50      // NSS bajo -> primer flanco de SCK
+#define RC522_CS_HOLD_NS        50      // Último flanco de SCK -> NSS alto
+#define RC522_DMA_TIMEOUT_US    5000    // Ráfaga FIFO por DMA
+#define RC522_RESET_TIMEOUT_MS  50      // Soft reset (arranque del oscilador)
+
+// Autoajuste del reloj SPI1 (BR de SPI_CR1, SCK = 90 MHz / 2^(BR+1)).
+// El RC522 admite hasta 10 MHz: /16 = 5.6 MHz es el más rápido permitido
+#ifndef RC522_SPI_BR_FASTEST
+#define RC522_SPI_BR_FASTEST    3       // /16 = 5.6 MHz
+#endif
+#define RC522_SPI_BR_SLOWEST    7       // /256 = 352 kHz
+#define RC522_LINK_ERR_MAX      3       // Errores antes de bajar la velocidad
+
+// Accesos de registro por medida en RC522_BenchRegAccess
+#define RC522_BENCH_LOOPS   64
+
+// Duración de un byte recibido a 106 kbit/s (9 bits = 85 us) con margen
+#define RC522_RX_US_PER_BYTE    100
+
+// Campo RF apagado en RC522_FieldReset (ISO 14443-2: >= 5 ms)
+#define RC522_FIELD_RESET_MS    5
+
+// Tamaño del FIFO interno del RC522
+#define RC522_FIFO_SIZE 64
 
 // =============== COMMANDOS PICC ==================
 #define PICC_REQA           0x26
+#define PICC_WUPA           0x52    // Despierta también las tarjetas en HALT
+#define PICC_HLTA           0x50    // HLTA = 0x50 0x00 + CRC_A
 #define PICC_ANTICOLL_CL1   0x93
 #define PICC_SELECT_CL1     0x93
+#define PICC_SELECT_CL2     0x95
+#define PICC_SELECT_CL3     0x97
+#define PICC_CASCADE_TAG    0x88    // Primer byte de un nivel incompleto
+
+// Bit de cascada del SAK: el UID continúa en el siguiente nivel
+#define PICC_SAK_CASCADE    0x04
 
 // =============== COMANDOS PCD ==================
 #define PCD_Idle        0x00
@@ -41,15 +96,65 @@
 #define PICC_AUTHENT1A  0x60
 #define PICC_AUTHENT1B  0x61
 
+// =============== POLÍTICA DE CRC =================
+#define RC522_CRC_NONE  0x00
+#define RC522_CRC_TX    0x01    // El RC522 añade CRC_A a la trama enviada
+#define RC522_CRC_RX    0x02    // El RC522 verifica y descarta el CRC_A recibido
+
+// =============== TIPOS DE TRAMA =================
+// Cada tipo tiene un descriptor en rc522.c: IRQs, máscara de error, bits
+// de trama, timeout y política de CRC
+typedef enum {
+    RC522_CMD_TRANSCEIVE = 0,   // Genérico (sin CRC, timeout por defecto)
+    RC522_CMD_REQA,
+    RC522_CMD_ANTICOLL,
+    RC522_CMD_SELECT,
+    RC522_CMD_AUTH,
+    RC522_CMD_READ,
+    RC522_CMD_WRITE,
+    RC522_CMD_HALT,
+    RC522_CMD_COUNT
+} RC522_Cmd;
+
 // =============== STATUS CODES ==================
 #define MI_OK           0x00
 #define MI_NOTAGERR     0x01
 #define MI_ERR          0x02
 
-// =============== FUNCIONES ======================
-void delay_ms(volatile uint32_t ms);
-void delay_us(volatile uint32_t us);
+// =============== ESTADÍSTICAS SPI ===============
+typedef struct {
+    uint32_t spiFrames;      // Transacciones SPI (ciclos de CS)
+    uint32_t regReads;       // Lecturas de registro por SPI
+    uint32_t regWrites;      // Escrituras de registro por SPI
+    uint32_t shadowHits;     // Lecturas servidas por la caché de registros
+    uint32_t writesSkipped;  // Escrituras redundantes evitadas
+} RC522_Stats;
+
+// Sondeos REQA sin tarjeta (ciclos de CPU medidos con Timing_Cycles)
+typedef struct {
+    uint32_t noCardPolls;    // Sondeos terminados sin respuesta
+    uint32_t lastCycles;     // Duración del último sondeo sin tarjeta
+    uint32_t maxCycles;      // Peor caso observado
+    uint32_t lastSpiFrames;  // Transacciones SPI del último sondeo
+} RC522_PollStats;
+
+// UID completo tras la cascada (4, 7 o 10 bytes, sin Cascade Tags)
+typedef struct {
+    uint8_t size;
+    uint8_t uid[10];
+    uint8_t sak;             // SAK del último nivel
+    uint8_t atqa[2];         // ATQA del REQA/WUPA que precedió al SELECT
+} RC522_Uid;
+
+// Estado del enlace SPI
+typedef struct {
+    uint8_t prescaler;       // BR actual de SPI1
+    uint32_t errors;         // Errores desde el último ajuste
+    uint32_t totalErrors;    // Errores acumulados
+    uint32_t fallbacks;      // Veces que se bajó la velocidad
+} RC522_LinkStats;
 
+// =============== FUNCIONES ======================
 void RC522_ResetLow(void);
 void RC522_ResetHigh(void);
 
@@ -60,31 +165,63 @@ void RC522_WriteReg(uint8_t addr, uint8_t val);
 uint8_t RC522_ReadReg(uint8_t addr);
 void RC522_SetBitMask(uint8_t reg, uint8_t mask);
 void RC522_ClearBitMask(uint8_t reg, uint8_t mask);
+
+// Acceso en ráfaga al FIFO (un solo CS, SPI1 por DMA2)
+void RC522_WriteFIFO(const uint8_t *data, uint8_t len);
+void RC522_ReadFIFO(uint8_t *data, uint8_t len);
 void RC522_StopCrypto1(void);
 
+void RC522_ResetStats(void);
+const RC522_Stats *RC522_GetStats(void);
+const RC522_PollStats *RC522_GetPollStats(void);
+void RC522_BenchRegAccess(uint32_t *cycles8, uint32_t *cycles16);
+
+// Autoajuste y supervisión del reloj SPI
+uint8_t RC522_LinkTest(void);
+uint8_t RC522_AutotuneSPI(void);
+uint8_t RC522_LinkCheck(void);
+const RC522_LinkStats *RC522_GetLinkStats(void);
+
 // =================== RC522 INIT ==================
 void RC522_Init(void);
 
-// Core ToCard function (from reference implementation)
-int RC522_ToCard(uint8_t command, uint8_t *sendData, uint8_t sendLen,
-                 uint8_t *backData, uint16_t *backLen);
+// Motor de transceive único (devuelve MI_OK / MI_NOTAGERR / MI_ERR)
+int RC522_Execute(RC522_Cmd cmd, const uint8_t *send, uint8_t sendLen,
+                  uint8_t *back, uint8_t *backLen, uint8_t *rxBits);
 
-int RC522_Transceive(uint8_t* send, uint8_t sendLen, uint8_t* back,
-                     uint8_t* backLen, uint8_t validBits);
+// Respuestas de más de 64 bytes (FIFO vaciado durante la recepción)
+int RC522_ExecuteLong(RC522_Cmd cmd, const uint8_t *send, uint8_t sendLen,
+                      uint8_t *back, uint16_t *backLen);
 
-int RC522_TransceiveEncrypted(uint8_t* send, uint8_t sendLen, uint8_t* back,
-                              uint8_t* backLen, uint8_t validBits);
+// La misma trama en dos fases (solapar trabajo del MCU con la trama)
+int RC522_Start(RC522_Cmd cmd, const uint8_t *send, uint8_t sendLen);
+int RC522_Finish(RC522_Cmd cmd, uint8_t *back, uint8_t *backLen, uint8_t *rxBits);
 
 int RC522_RequestA(uint8_t* atqa, uint8_t* atqaLen);
-int RC522_AnticollCL1(uint8_t* uid, uint8_t* uidLen);
-int RC522_Select(uint8_t* uid);
+int RC522_WakeupA(uint8_t* atqa, uint8_t* atqaLen);
+int RC522_HaltA(void);
+void RC522_FieldReset(void);
+
+// Anticolisión y SELECT de todos los niveles de cascada (CL1..CL3)
+int RC522_SelectCard(RC522_Uid *card);
+
+// WUPA + SELECT de la última tarjeta seleccionada (sin anticolisión)
+int RC522_Reselect(RC522_Uid *card);
+int RC522_ReselectCard(RC522_Uid *card);
+int RC522_SelectUid(const RC522_Uid *card);
+
+// Igual con REQA: las tarjetas en HALT no despiertan
+int RC522_SelectUidIdle(const RC522_Uid *card);
+
+// CRC_A (ISO 14443-3) calculada en el MCU, resultado little-endian
+void RC522_CalculateCRC(uint8_t *data, uint16_t len, uint8_t *result);
 
-// CRC calculation
-void RC522_CalculateCRC(uint8_t *data, uint8_t len, uint8_t *result);
+// Modo CRC hardware (offload)
+void RC522_SetCRCOffload(uint8_t enable);
+uint8_t RC522_CRCOffload(void);
+uint8_t RC522_AppendCRC(uint8_t *buf, uint8_t len);
 
-// Authentication and block operations
+// Authentication (las operaciones de bloque están en mifare.h)
 int RC522_Auth(uint8_t authMode, uint8_t blockAddr, uint8_t *key, uint8_t *uid);
-int RC522_ReadBlock(uint8_t blockAddr, uint8_t *data, uint8_t *uid);
-int RC522_WriteBlock(uint8_t blockAddr, uint8_t *data, uint8_t *uid);
 
 #endif
@@ -0,0 +1,454 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sync.h"
+#include "whitelist.h"
+#include "flash.h"
+#include "usart.h"
+#include "timing.h"
+#include "journal.h"
+
+typedef enum {
+    SYNC_IDLE = 0,
+    SYNC_WAIT_ERASE,         // BEGIN recibido, falta borrar el banco inactivo
+    SYNC_RECEIVING,          // Lotes ADD/DEL
+    SYNC_MERGING             // COMMIT: fusión en el banco inactivo
+} sync_state_t;
+
+static sync_state_t state = SYNC_IDLE;
+static uint8_t dirty;                    // Banco inactivo sin borrar
+
+// Línea en recepción
+static char line[SYNC_LINE_MAX];
+static uint16_t line_len;
+static uint8_t in_line;
+static uint8_t line_overflow;
+
+// Delta pendiente (disjuntos: una alta anula la baja del mismo UID)
+static Whitelist_Entry adds[SYNC_MAX_CHANGES];
+static Whitelist_Entry dels[SYNC_MAX_CHANGES];
+static uint16_t n_adds, n_dels;
+static uint32_t target_version;
+static uint32_t base_version;
+static uint32_t expect_seq;
+
+// Fusión
+static Whitelist_Entry old_entry;        // Entrada oi del banco activo
+static uint32_t old_count;
+static uint32_t oi, ai, di, out;
+static uint32_t out_count[WHITELIST_TABLES];
+static uint32_t out_bytes;               // Bytes de tablas escritos
+static uint32_t out_word;                // Palabra en curso (0xFF sin usar)
+static uint32_t bank_addr;
+static uint32_t expect_crc;
+static uint32_t commit_seq;
+
+static uint8_t inactive_bank(void) {
+    return Whitelist_ActiveBank() ^ 1;
+}
+
+static void reply(const char *fmt, uint32_t a, uint32_t b, uint32_t c) {
+    char msg[64];
+    sprintf(msg, fmt, (unsigned int)a, (unsigned int)b, (unsigned int)c);
+    USART1_SendString(msg);
+}
+
+static void reply_digest(void) {
+    reply("SYNC:DIGEST:%u:%u:%08X\r\n", Whitelist_Version(), Whitelist_Count(), Whitelist_Digest());
+}
+
+static int entry_cmp(const void *a, const void *b) {
+    return memcmp(a, b, sizeof(Whitelist_Entry));
+}
+
+// =================== Análisis de líneas ===================
+
+static uint8_t parse_u32(const char **p, uint32_t *value, uint8_t base) {
+    char *end;
+    *value = (uint32_t)strtoul(*p, &end, base);
+    if(end == *p) {
+        return 0;
+    }
+    *p = end;
+    return 1;
+}
+
+static int8_t hex_nibble(char c) {
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// UID de 4, 7 o 10 bytes en hexadecimal hasta ',' o fin de línea
+static uint8_t parse_uid(const char **p, Whitelist_Entry *e) {
+    const char *s = *p;
+    uint8_t n = 0;
+
+    memset(e, 0, sizeof(*e));
+    while(hex_nibble(s[0]) >= 0 && hex_nibble(s[1]) >= 0) {
+        if(n >= sizeof(e->uid)) {
+            return 0;
+        }
+        e->uid[n++] = (uint8_t)((hex_nibble(s[0]) << 4) | hex_nibble(s[1]));
+        s += 2;
+    }
+    if((n != 4 && n != 7 && n != 10) || (*s != ',' && *s != '\0')) {
+        return 0;
+    }
+    e->size = n;
+    *p = (*s == ',') ? s + 1 : s;
+    return 1;
+}
+
+// =================== Delta en RAM ===================
+
+static int find(const Whitelist_Entry *list, uint16_t n, const Whitelist_Entry *e) {
+    for(uint16_t i = 0; i < n; i++) {
+        if(memcmp(&list[i], e, sizeof(*e)) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void stage(Whitelist_Entry *list, uint16_t *n,
+                  Whitelist_Entry *other, uint16_t *nOther, const Whitelist_Entry *e) {
+    int i = find(other, *nOther, e);
+    if(i >= 0) {
+        other[i] = other[--(*nOther)];
+    }
+    if(find(list, *n, e) < 0) {
+        list[(*n)++] = *e;
+    }
+}
+
+// Lote ADD/DEL: se valida entero antes de aplicarlo
+static void handle_batch(const char *p, uint8_t isAdd) {
+    uint32_t seq;
+    Whitelist_Entry e;
+    const char *uids;
+    uint16_t count = 0;
+
+    if(!parse_u32(&p, &seq, 10) || *p++ != ':') {
+        reply("SYNC:NAK:0:FORMAT\r\n", 0, 0, 0);
+        return;
+    }
+    if(state != SYNC_RECEIVING) {
+        reply("SYNC:NAK:%u:STATE\r\n", seq, 0, 0);
+        return;
+    }
+    if(seq + 1 == expect_seq) {
+        reply("SYNC:ACK:%u\r\n", seq, 0, 0);       // Reintento del gateway
+        return;
+    }
+    if(seq != expect_seq) {
+        reply("SYNC:NAK:%u:SEQ:%u\r\n", seq, expect_seq, 0);
+        return;
+    }
+
+    uids = p;
+    while(*p) {
+        if(!parse_uid(&p, &e)) {
+            reply("SYNC:NAK:%u:FORMAT\r\n", seq, 0, 0);
+            return;
+        }
+        count++;
+    }
+    if(count > SYNC_MAX_CHANGES - (isAdd ? n_adds : n_dels)) {
+        reply("SYNC:NAK:%u:FULL\r\n", seq, 0, 0);
+        return;
+    }
+
+    for(p = uids; *p; ) {
+        parse_uid(&p, &e);
+        if(isAdd) {
+            stage(adds, &n_adds, dels, &n_dels, &e);
+        } else {
+            stage(dels, &n_dels, adds, &n_adds, &e);
+        }
+    }
+    expect_seq++;
+    reply("SYNC:ACK:%u\r\n", seq, 0, 0);
+}
+
+static void handle_begin(const char *p) {
+    uint32_t base, target;
+    uint32_t current = Whitelist_Version();
+
+    if(!parse_u32(&p, &base, 10) || *p++ != ':' || !parse_u32(&p, &target, 10)) {
+        reply("SYNC:NAK:0:FORMAT\r\n", 0, 0, 0);
+        return;
+    }
+    if(state == SYNC_MERGING) {
+        reply("SYNC:NAK:0:BUSY\r\n", 0, 0, 0);
+        return;
+    }
+    // Versiones crecientes: al arrancar gana el banco de versión más alta
+    if((base != 0 && base != current) || target <= current) {
+        reply("SYNC:NAK:0:VERSION:%u\r\n", current, 0, 0);
+        return;
+    }
+
+    n_adds = n_dels = 0;
+    base_version = base;
+    target_version = target;
+    expect_seq = 1;
+    if(dirty) {
+        state = SYNC_WAIT_ERASE;            // ACK tras el borrado
+    } else {
+        state = SYNC_RECEIVING;
+        reply("SYNC:ACK:0\r\n", 0, 0, 0);
+    }
+}
+
+static void handle_commit(const char *p) {
+    uint32_t seq, crc;
+
+    if(!parse_u32(&p, &seq, 10) || *p++ != ':' || !parse_u32(&p, &crc, 16)) {
+        reply("SYNC:NAK:0:FORMAT\r\n", 0, 0, 0);
+        return;
+    }
+    if(state != SYNC_RECEIVING || seq != expect_seq) {
+        reply("SYNC:NAK:%u:SEQ:%u\r\n", seq, expect_seq, 0);
+        return;
+    }
+
+    qsort(adds, n_adds, sizeof(Whitelist_Entry), entry_cmp);
+    qsort(dels, n_dels, sizeof(Whitelist_Entry), entry_cmp);
+
+    // base 0: recarga completa sobre el conjunto vacío
+    old_count = base_version ? Whitelist_Count() : 0;
+    if(old_count) {
+        Whitelist_Get(0, &old_entry);
+    }
+    oi = ai = di = out = 0;
+    memset(out_count, 0, sizeof(out_count));
+    out_bytes = 0;
+    out_word = 0xFFFFFFFFUL;
+    bank_addr = Whitelist_BankAddr(inactive_bank());
+    expect_crc = crc;
+    commit_seq = seq;
+    dirty = 1;
+    state = SYNC_MERGING;
+    Flash_Unlock();
+}
+
+static void handle_line(const char *p) {
+    // Confirmaciones del diario
+    if(strncmp(p, "LOG:", 4) == 0) {
+        Journal_Command(p + 4);
+        return;
+    }
+    if(strncmp(p, "SYNC:", 5) != 0) {
+        return;
+    }
+    p += 5;
+
+    if(strcmp(p, "DIGEST") == 0) {
+        reply_digest();
+    } else if(strcmp(p, "ABORT") == 0) {
+        if(state == SYNC_MERGING) {
+            Flash_Lock();
+        }
+        state = SYNC_IDLE;
+        reply("SYNC:ACK:0\r\n", 0, 0, 0);
+    } else if(strncmp(p, "BEGIN:", 6) == 0) {
+        handle_begin(p + 6);
+    } else if(strncmp(p, "ADD:", 4) == 0) {
+        handle_batch(p + 4, 1);
+    } else if(strncmp(p, "DEL:", 4) == 0) {
+        handle_batch(p + 4, 0);
+    } else if(strncmp(p, "COMMIT:", 7) == 0) {
+        handle_commit(p + 7);
+    } else {
+        reply("SYNC:NAK:0:FORMAT\r\n", 0, 0, 0);
+    }
+}
+
+// =================== Fusión en flash ===================
+
+static void merge_fail(const char *reason) {
+    char msg[48];
+    Flash_Lock();
+    state = SYNC_IDLE;
+    sprintf(msg, "SYNC:NAK:%u:%s\r\n", (unsigned int)commit_seq, reason);
+    USART1_SendString(msg);
+}
+
+// Añade un UID a las tablas del banco nuevo: los bytes se acumulan en
+// out_word y cada palabra se programa al completarse
+static int emit(const Whitelist_Entry *e) {
+    uint32_t body = bank_addr + sizeof(Whitelist_Header);
+
+    for(uint8_t i = 0; i < e->size; i++) {
+        uint8_t shift = (out_bytes & 3) * 8;
+        out_word = (out_word & ~(0xFFUL << shift)) | ((uint32_t)e->uid[i] << shift);
+        if((++out_bytes & 3) == 0) {
+            if(Flash_ProgramWord(body + out_bytes - 4, out_word) != 0) {
+                return -1;
+            }
+            out_word = 0xFFFFFFFFUL;
+        }
+    }
+    out_count[WHITELIST_TABLE(e->size)]++;
+    out++;
+    return 0;
+}
+
+static void merge_finish(void) {
+    uint32_t body = bank_addr + sizeof(Whitelist_Header);
+    uint32_t crc;
+    char msg[64];
+
+    // Última palabra a medias: el resto queda a 0xFF, como en imagegen.py
+    if((out_bytes & 3) != 0 && Flash_ProgramWord(body + (out_bytes & ~3UL), out_word) != 0) {
+        merge_fail("FLASH");
+        return;
+    }
+    crc = Whitelist_CRC((const void *)body, (out_bytes + 3) & ~3UL);
+    if(crc != expect_crc) {
+        Flash_Lock();
+        state = SYNC_IDLE;
+        reply("SYNC:NAK:%u:DIGEST:%08X\r\n", commit_seq, crc, 0);
+        return;
+    }
+
+    // Cabecera al final y magic en último lugar: hasta aquí el banco no es válido
+    if(Flash_ProgramWord(bank_addr + 4, target_version) != 0 ||
+       Flash_ProgramWord(bank_addr + 8, out_count[0]) != 0 ||
+       Flash_ProgramWord(bank_addr + 12, out_count[1]) != 0 ||
+       Flash_ProgramWord(bank_addr + 16, out_count[2]) != 0 ||
+       Flash_ProgramWord(bank_addr + 20, crc) != 0 ||
+       Flash_ProgramWord(bank_addr, WHITELIST_MAGIC) != 0) {
+        merge_fail("FLASH");
+        return;
+    }
+    Flash_Lock();
+
+    if(Whitelist_Activate(inactive_bank()) != 0) {
+        state = SYNC_IDLE;
+        reply("SYNC:NAK:%u:FLASH\r\n", commit_seq, 0, 0);
+        return;
+    }
+    state = SYNC_IDLE;                      // El banco anterior queda por borrar
+    reply("SYNC:ACK:%u\r\n", commit_seq, 0, 0);
+    reply_digest();
+
+    sprintf(msg, "\r\n[Sync] Lista blanca v%u: %u UIDs\r\n",
+            (unsigned int)target_version, (unsigned int)out);
+    USART_SendString(msg);
+}
+
+static void merge_slice(void) {
+    uint32_t deadline = deadline_us(SYNC_SLICE_US);
+
+    while(!deadline_expired(deadline, micros())) {
+        const Whitelist_Entry *o = (oi < old_count) ? &old_entry : NULL;
+        const Whitelist_Entry *a = (ai < n_adds) ? &adds[ai] : NULL;
+        const Whitelist_Entry *next;
+
+        if(o == NULL && a == NULL) {
+            merge_finish();
+            return;
+        }
+
+        // Menor de las dos listas ordenadas; un alta ya presente cuenta una vez
+        if(o != NULL && (a == NULL || entry_cmp(o, a) <= 0)) {
+            if(a != NULL && entry_cmp(o, a) == 0) {
+                ai++;
+            }
+            next = o;
+        } else {
+            next = a;
+            ai++;
+        }
+
+        while(di < n_dels && entry_cmp(&dels[di], next) < 0) {
+            di++;
+        }
+        if(di < n_dels && entry_cmp(&dels[di], next) == 0) {
+            // Baja: no se copia
+        } else if(out_bytes + next->size > WHITELIST_BODY_MAX) {
+            merge_fail("FULL");
+            return;
+        } else if(emit(next) != 0) {
+            merge_fail("FLASH");
+            return;
+        }
+
+        // old_entry se reutiliza: avanzar después de copiarla
+        if(next == o && ++oi < old_count) {
+            Whitelist_Get(oi, &old_entry);
+        }
+    }
+}
+
+// =================== Interfaz ===================
+
+void Sync_Init(void) {
+    state = SYNC_IDLE;
+    in_line = 0;
+    dirty = !Flash_IsBlank(Whitelist_BankAddr(inactive_bank()), WHITELIST_SIZE);
+}
+
+uint8_t Sync_Feed(uint8_t ch) {
+    if(!in_line) {
+        if(ch == '\r' || ch == '\n') {
+            return 1;
+        }
+        if(ch >= '0' && ch <= '2') {
+            return 0;
+        }
+        in_line = 1;
+        line_len = 0;
+        line_overflow = 0;
+    }
+
+    if(ch == '\r' || ch == '\n') {
+        in_line = 0;
+        line[line_len] = '\0';
+        if(line_overflow) {
+            reply("SYNC:NAK:0:LENGTH\r\n", 0, 0, 0);
+        } else {
+            handle_line(line);
+        }
+        return 1;
+    }
+
+    if(line_len < SYNC_LINE_MAX - 1) {
+        line[line_len++] = (char)ch;
+    } else {
+        line_overflow = 1;
+    }
+    return 1;
+}
+
+void Sync_Poll(uint8_t idle) {
+    if(state == SYNC_MERGING) {
+        merge_slice();
+        return;
+    }
+
+    // Borrado del banco inactivo: solo con el campo vacío
+    if(dirty && idle && (state == SYNC_IDLE || state == SYNC_WAIT_ERASE)) {
+        Flash_Unlock();
+        int result = Flash_EraseSector(FLASH_SECTOR_WL_A + inactive_bank());
+        Flash_Lock();
+        dirty = (result != 0);
+
+        if(state == SYNC_WAIT_ERASE) {
+            if(dirty) {
+                state = SYNC_IDLE;
+                reply("SYNC:NAK:0:FLASH\r\n", 0, 0, 0);
+            } else {
+                state = SYNC_RECEIVING;
+                reply("SYNC:ACK:0\r\n", 0, 0, 0);
+            }
+        }
+    }
+}
+
+uint8_t Sync_Busy(void) {
+    return state != SYNC_IDLE;
+}
@@ -0,0 +1,56 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <stdint.h>
+
+// ===== Sincronización incremental de la lista blanca (USART1) =====
+// Líneas de texto, como el resto del protocolo con el NodeMCU:
+//
+//   SYNC:DIGEST                     -> SYNC:DIGEST:<versión>:<n>:<crc>
+//   SYNC:BEGIN:<base>:<destino>     -> SYNC:ACK:0
+//   SYNC:ADD:<seq>:<uid>[,<uid>...] -> SYNC:ACK:<seq>
+//   SYNC:DEL:<seq>:<uid>[,<uid>...] -> SYNC:ACK:<seq>
+//   SYNC:COMMIT:<seq>:<crc>         -> SYNC:ACK:<seq> + SYNC:DIGEST:...
+//   SYNC:ABORT                      -> SYNC:ACK:0
+//   (errores: SYNC:NAK:<seq>:<motivo>[:<dato>])
+//
+// base es la versión sobre la que se aplica el delta (0: conjunto vacío,
+// recarga completa). seq empieza en 1; un lote repetido se vuelve a
+// confirmar sin aplicarlo. uid: 4, 7 o 10 bytes en hexadecimal. crc es
+// el CRC-32 STM32 de las tablas finales completadas con 0xFF a múltiplo
+// de 4 bytes (mismo cálculo que tools/imagegen.py): si no coincide no se
+// activa.
+//
+// Los cambios se acumulan en RAM y en el COMMIT se fusionan con el banco
+// activo en el inactivo, unas pocas entradas por vuelta del bucle, sin
+// parar el sondeo. La cabecera se escribe la última: un corte deja el
+// banco anterior en uso. El borrado del banco inactivo (1-2 s con la CPU
+// parada) solo se hace sin tarjetas en el campo.
+//
+// Durante ese borrado la recepción por USART1 se pierde: el gateway debe
+// esperar el SYNC:ACK:0 del BEGIN (llega cuando el banco ya está borrado)
+// antes de enviar el primer ADD/DEL, y en adelante una línea cada vez,
+// reenviándola si no llega su ACK. Mientras hay una actualización en
+// curso el diario no recicla segmentos (Sync_Busy), así que no hay más
+// borrados hasta el COMMIT.
+#ifndef SYNC_MAX_CHANGES
+#define SYNC_MAX_CHANGES    256     // Altas y bajas pendientes de cada tipo
+#endif
+#define SYNC_LINE_MAX       192
+#define SYNC_SLICE_US       5000    // Tiempo de fusión por llamada a Sync_Poll
+
+// ===== Funciones =====
+extern void Sync_Init(void);
+
+// Byte recibido por USART1; 1 si pertenece a una línea del protocolo
+// (SYNC:..., y LOG:... que pasa a Journal_Command). Los códigos de nivel
+// '0'-'2' sueltos siguen siendo del bucle principal
+extern uint8_t Sync_Feed(uint8_t ch);
+
+// Trabajo en segundo plano; idle: sin tarjetas en el campo (se permite borrar)
+extern void Sync_Poll(uint8_t idle);
+
+// 1 mientras hay una actualización en curso
+extern uint8_t Sync_Busy(void);
+
+#endif
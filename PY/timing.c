@@ -0,0 +1,82 @@
+#include <stm32f446xx.h>
+#include "timing.h"
+
+// Milisegundos desde Timing_Init (desborda a los ~49 días)
+static volatile uint32_t ms_ticks = 0;
+
+// Inicio de la última parada (Timing_StallBegin)
+static uint32_t stall_cycles;
+static uint32_t stall_ticks;
+
+// =================== INIT ========================
+void Timing_Init(void) {
+    // Contador de ciclos DWT
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    
+    // SysTick desde HCLK, interrupción cada 1 ms
+    SysTick->CTRL = 0;
+    SysTick->LOAD = TIMING_TICK_CYCLES - 1;
+    SysTick->VAL = 0;
+    NVIC_SetPriority(SysTick_IRQn, 0);
+    SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk |
+                    SysTick_CTRL_ENABLE_Msk;
+}
+
+void SysTick_Handler(void) {
+    ms_ticks++;
+}
+
+// =================== RELOJ =======================
+uint32_t millis(void) {
+    return ms_ticks;
+}
+
+uint32_t micros(void) {
+    uint32_t ms, val;
+    
+    // Releer si SysTick pasó por cero entre las dos lecturas
+    do {
+        ms = ms_ticks;
+        val = SysTick->VAL;
+    } while(ms != ms_ticks);
+    
+    // VAL cuenta hacia abajo desde LOAD
+    return ms * 1000UL + (TIMING_TICK_CYCLES - 1 - val) / TIMING_CYCLES_PER_US;
+}
+
+void Timing_StallBegin(void) {
+    stall_cycles = DWT->CYCCNT;
+    stall_ticks = ms_ticks;
+}
+
+void Timing_StallEnd(void) {
+    uint32_t elapsed = (DWT->CYCCNT - stall_cycles) / TIMING_TICK_CYCLES;
+    
+    // SysTick solo deja un tick pendiente durante la parada
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t seen = ms_ticks - stall_ticks;
+    if(elapsed > seen) {
+        ms_ticks += elapsed - seen;
+    }
+    __set_PRIMASK(primask);
+}
+
+// =================== DELAYS ======================
+// Basados en DWT: funcionan también con interrupciones deshabilitadas
+void delay_us(uint32_t us) {
+    // Por tramos de 1 s para no desbordar la resta de 32 bits
+    while(us > 1000000UL) {
+        delay_cycles(1000000UL * TIMING_CYCLES_PER_US);
+        us -= 1000000UL;
+    }
+    delay_cycles(us * TIMING_CYCLES_PER_US);
+}
+
+void delay_ms(uint32_t ms) {
+    while(ms--) {
+        delay_cycles(TIMING_TICK_CYCLES);
+    }
+}
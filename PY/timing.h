@@ -0,0 +1,55 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stm32f446xx.h>
+#include <stdint.h>
+
+// ===== Base de tiempo =====
+// DWT->CYCCNT cuenta ciclos del núcleo (180 MHz) y SysTick interrumpe cada
+// 1 ms para el reloj monotónico. Ningún retardo depende del compilador
+// ni de los wait-states de la flash.
+#define TIMING_CPU_HZ           180000000UL
+#define TIMING_CYCLES_PER_US    (TIMING_CPU_HZ / 1000000UL)
+#define TIMING_TICK_CYCLES      (TIMING_CPU_HZ / 1000UL)    // SysTick = 1 ms
+
+// Ciclos equivalentes a ns nanosegundos (redondeo hacia arriba)
+#define TIMING_NS_TO_CYCLES(ns) ((((uint32_t)(ns)) * (TIMING_CPU_HZ / 1000000UL) + 999UL) / 1000UL)
+
+// ===== Funciones =====
+extern void Timing_Init(void);
+
+extern uint32_t millis(void);
+extern uint32_t micros(void);
+
+// Parada de la CPU sin interrupciones (borrado de un sector de flash:
+// la ISR de SysTick está en flash y no corre). Al terminar se suman a
+// millis() los ticks perdidos, medidos con DWT->CYCCNT (hasta ~23 s)
+extern void Timing_StallBegin(void);
+extern void Timing_StallEnd(void);
+
+extern void delay_us(uint32_t us);
+extern void delay_ms(uint32_t ms);
+
+// Contador de ciclos en bruto (diferencias válidas hasta ~23 s)
+static inline uint32_t Timing_Cycles(void) {
+    return DWT->CYCCNT;
+}
+
+// Espera activa de al menos cycles ciclos: para guardas de decenas de ns
+// (CS del SPI) donde llamar a delay_us sería 1000 veces demasiado largo
+static inline void delay_cycles(uint32_t cycles) {
+    uint32_t start = DWT->CYCCNT;
+    while((DWT->CYCCNT - start) < cycles);
+}
+
+// Plazos absolutos en ms / us: comparación con signo, válida tras el
+// desbordamiento del contador
+static inline uint32_t deadline_us(uint32_t us) {
+    return micros() + us;
+}
+
+static inline uint8_t deadline_expired(uint32_t deadline, uint32_t now) {
+    return (int32_t)(now - deadline) >= 0;
+}
+
+#endif
@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""
+Generador de imágenes de flash para el lector STM32F446.
+
+  imagegen.py whitelist uids.txt -o whitelist.bin [--version N]
+  imagegen.py bloom revocadas.txt -o bloom.bin --fp 0.01 [--version N]
+
+Entrada: un UID por línea en hexadecimal (4, 7 o 10 bytes), '#' comenta.
+Salida: imagen binaria para grabar en la dirección indicada, p. ej.
+  st-flash write whitelist.bin 0x08040000
+  st-flash write bloom.bin 0x0800C000
+
+Formatos y hashes idénticos a whitelist.c y bloom.c.
+"""
+
+import argparse
+import math
+import struct
+import sys
+
+WHITELIST_ADDR = 0x08040000
+WHITELIST_SIZE = 0x20000
+WHITELIST_MAGIC = 0x32534C57        # "WLS2"
+WHITELIST_HEADER = 24
+
+BLOOM_ADDR = 0x0800C000
+BLOOM_SIZE = 0x4000
+BLOOM_MAGIC = 0x314D4C42            # "BLM1"
+BLOOM_HEADER = 24
+BLOOM_MAX_HASHES = 16
+
+MASK32 = 0xFFFFFFFF
+
+
+def stm32_crc(data):
+    """CRC-32 de la unidad CRC del STM32: poli 0x04C11DB7, inicial
+    0xFFFFFFFF, sin reflexión ni XOR final, palabras little-endian."""
+    crc = 0xFFFFFFFF
+    for (word,) in struct.iter_unpack("<I", data):
+        crc ^= word
+        for _ in range(32):
+            crc = ((crc << 1) ^ 0x04C11DB7) if crc & 0x80000000 else (crc << 1)
+            crc &= MASK32
+    return crc
+
+
+def read_uids(path):
+    uids = set()
+    with open(path) as f:
+        for n, line in enumerate(f, 1):
+            line = line.split("#", 1)[0].strip().replace(":", "").replace(" ", "")
+            if not line:
+                continue
+            try:
+                uid = bytes.fromhex(line)
+            except ValueError:
+                sys.exit("%s:%d: UID no hexadecimal: %s" % (path, n, line))
+            if len(uid) not in (4, 7, 10):
+                sys.exit("%s:%d: UID de %d bytes" % (path, n, len(uid)))
+            uids.add(uid)
+    return sorted(uids)
+
+
+# =================== Lista blanca ===================
+
+def whitelist_image(uids, version):
+    # Una tabla por tamaño (4, 7, 10), seguidas, en el orden de memcmp
+    tables = [sorted(uid for uid in uids if len(uid) == size) for size in (4, 7, 10)]
+    body = b"".join(b"".join(table) for table in tables)
+    body += b"\xff" * (-len(body) % 4)    # Resto de la última palabra a 0xFF
+
+    if WHITELIST_HEADER + len(body) > WHITELIST_SIZE:
+        sys.exit("%d UIDs no caben en %d KB" % (len(uids), WHITELIST_SIZE // 1024))
+    header = struct.pack("<IIIIII", WHITELIST_MAGIC, version,
+                         len(tables[0]), len(tables[1]), len(tables[2]), stm32_crc(body))
+    return header + body, "%d UIDs (%d de 4 bytes, %d de 7, %d de 10)" % (
+        len(uids), len(tables[0]), len(tables[1]), len(tables[2]))
+
+
+# =================== Filtro de Bloom ===================
+
+def fnv1a(uid):
+    h = 2166136261
+    for b in bytes([len(uid)]) + uid:
+        h = ((h ^ b) * 16777619) & MASK32
+    return h
+
+
+def mix(h):
+    h ^= h >> 16
+    h = (h * 0x85EBCA6B) & MASK32
+    h ^= h >> 13
+    h = (h * 0xC2B2AE35) & MASK32
+    h ^= h >> 16
+    return h
+
+
+def bloom_image(uids, version, fp):
+    n = max(len(uids), 1)
+    max_bits = (BLOOM_SIZE - BLOOM_HEADER) * 8
+
+    # m = -n ln p / (ln 2)^2, k = m/n ln 2
+    m = int(math.ceil(-n * math.log(fp) / (math.log(2) ** 2)))
+    m = (m + 31) // 32 * 32
+    if m > max_bits:
+        sys.exit("%d UIDs con fp=%g necesitan %d bits (máx %d): subir --fp"
+                 % (len(uids), fp, m, max_bits))
+    k = min(max(1, int(round(m / n * math.log(2)))), BLOOM_MAX_HASHES)
+
+    bits = bytearray(m // 8)
+    for uid in uids:
+        h1 = fnv1a(uid)
+        h2 = mix(h1) | 1
+        for i in range(k):
+            bit = ((h1 + i * h2) & MASK32) % m
+            bits[bit >> 3] |= 1 << (bit & 7)
+
+    body = bytes(bits)
+    header = struct.pack("<IIIIII", BLOOM_MAGIC, version, m, k, len(uids), stm32_crc(body))
+    real_fp = (1 - math.exp(-k * len(uids) / m)) ** k
+    return header + body, "%d UIDs, m=%d bits, k=%d, fp=%.4f %%" % (len(uids), m, k, real_fp * 100)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("kind", choices=("whitelist", "bloom"))
+    ap.add_argument("input")
+    ap.add_argument("-o", "--output", required=True)
+    ap.add_argument("--version", type=int, default=1, help="versión del conjunto")
+    ap.add_argument("--fp", type=float, default=0.01, help="falsos positivos del filtro (bloom)")
+    args = ap.parse_args()
+
+    uids = read_uids(args.input)
+    if args.kind == "whitelist":
+        image, info = whitelist_image(uids, args.version)
+        addr = WHITELIST_ADDR
+    else:
+        if not 0 < args.fp < 1:
+            sys.exit("--fp debe estar entre 0 y 1")
+        image, info = bloom_image(uids, args.version, args.fp)
+        addr = BLOOM_ADDR
+
+    with open(args.output, "wb") as f:
+        f.write(image)
+    print("%s: %s, %d bytes -> 0x%08X" % (args.output, info, len(image), addr))
+
+
+if __name__ == "__main__":
+    main()
@@ -31,15 +31,57 @@ void USART_PrintHex(uint8_t *buffer, uint8_t len) {
 
 // ========== Funciones USART1 (NodeMCU) ==========
 
+// Cola de recepción llenada por interrupción: los bytes que llegan
+// mientras el bucle procesa una tarjeta no se pierden por overrun
+static volatile uint8_t rx1_buf[USART1_RX_SIZE];
+static volatile uint16_t rx1_head = 0;
+static volatile uint16_t rx1_tail = 0;
+
+// Cola de transmisión vaciada por TXE: a 9600 baudios una línea tarda
+// decenas de ms y el bucle no la espera (solo si la cola se llena)
+static volatile uint8_t tx1_buf[USART1_TX_SIZE];
+static volatile uint16_t tx1_head = 0;
+static volatile uint16_t tx1_tail = 0;
+
+void USART1_IRQHandler(void) {
+    uint32_t sr = USART1->SR;
+    
+    if(sr & (USART_SR_RXNE | USART_SR_ORE)) {
+        uint8_t ch = (uint8_t)USART1->DR;   // Lectura de DR: limpia RXNE y ORE
+        uint16_t next = (rx1_head + 1) % USART1_RX_SIZE;
+        if((sr & USART_SR_RXNE) && next != rx1_tail) {  // Cola llena: se descarta
+            rx1_buf[rx1_head] = ch;
+            rx1_head = next;
+        }
+    }
+    
+    if((sr & USART_SR_TXE) && (USART1->CR1 & USART_CR1_TXEIE)) {
+        if(tx1_tail != tx1_head) {
+            USART1->DR = tx1_buf[tx1_tail];
+            tx1_tail = (tx1_tail + 1) % USART1_TX_SIZE;
+        } else {
+            USART1->CR1 &= ~USART_CR1_TXEIE;
+        }
+    }
+}
+
 void USART1_Sendchar(uint8_t ch) {
-    while(!(USART1->SR & USART_SR_TXE));
-    USART1->DR = ch;
-    while(!(USART1->SR & USART_SR_TC));
+    uint16_t next = (tx1_head + 1) % USART1_TX_SIZE;
+    while(next == tx1_tail);            // Cola llena: esperar a la interrupción
+    tx1_buf[tx1_head] = ch;
+    tx1_head = next;
+    USART1->CR1 |= USART_CR1_TXEIE;
+}
+
+uint16_t USART1_TxFree(void) {
+    return (uint16_t)((tx1_tail + USART1_TX_SIZE - tx1_head - 1) % USART1_TX_SIZE);
 }
 
 uint8_t USART1_Receivechar(void) {
-    while(!(USART1->SR & USART_SR_RXNE));
-    return (uint8_t)USART1->DR;
+    while(rx1_head == rx1_tail);
+    uint8_t ch = rx1_buf[rx1_tail];
+    rx1_tail = (rx1_tail + 1) % USART1_RX_SIZE;
+    return ch;
 }
 
 void USART1_SendString(const char *str) {
@@ -49,5 +91,5 @@ void USART1_SendString(const char *str) {
 }
 
 uint8_t USART1_Available(void) {
-    return (USART1->SR & USART_SR_RXNE) ? 1 : 0;
+    return (rx1_head != rx1_tail) ? 1 : 0;
 }
@@ -10,9 +10,20 @@ extern void USART_SendString(const char *str);
 extern void USART_PrintHex(uint8_t *buffer, uint8_t len);
 
 // ===== Funciones USART1 (NodeMCU) =====
+// Recepción y transmisión por interrupción en colas de USART1_RX_SIZE y
+// USART1_TX_SIZE bytes
+#ifndef USART1_RX_SIZE
+#define USART1_RX_SIZE      256
+#endif
+#ifndef USART1_TX_SIZE
+#define USART1_TX_SIZE      512
+#endif
+
 extern void USART1_Sendchar(uint8_t ch);
 extern uint8_t USART1_Receivechar(void);
 extern void USART1_SendString(const char *str);
 extern uint8_t USART1_Available(void);
+extern uint16_t USART1_TxFree(void);
+extern void USART1_IRQHandler(void);
 
 #endif
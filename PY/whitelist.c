@@ -0,0 +1,144 @@
+#include <stm32f446xx.h>
+#include <string.h>
+#include "whitelist.h"
+
+static const Whitelist_Header *header = (const Whitelist_Header *)WHITELIST_ADDR;
+static const uint8_t *body = (const uint8_t *)(WHITELIST_ADDR + sizeof(Whitelist_Header));
+
+static uint8_t valid = 0;
+static uint8_t active = 0;
+
+uint32_t Whitelist_CRC(const void *data, uint32_t len) {
+    const uint32_t *w = (const uint32_t *)data;
+
+    RCC->AHB1ENR |= RCC_AHB1ENR_CRCEN;
+    CRC->CR = CRC_CR_RESET;
+    for(uint32_t i = 0; i < len / 4; i++) {
+        CRC->DR = w[i];
+    }
+    return CRC->DR;
+}
+
+uint32_t Whitelist_BankAddr(uint8_t bank) {
+    return bank ? WHITELIST_ADDR_B : WHITELIST_ADDR;
+}
+
+// Bytes de las tablas completados a múltiplo de 4 en *size; 0 si no caben
+static uint8_t body_size(const Whitelist_Header *h, uint32_t *size) {
+    *size = 0;
+    for(uint8_t t = 0; t < WHITELIST_TABLES; t++) {
+        if(h->count[t] > WHITELIST_MAX_ENTRIES) {
+            return 0;
+        }
+        *size += h->count[t] * WHITELIST_UID_SIZE(t);
+    }
+    *size = (*size + 3) & ~3UL;
+    return *size <= WHITELIST_BODY_MAX;
+}
+
+static uint8_t bank_valid(uint8_t bank) {
+    const Whitelist_Header *h = (const Whitelist_Header *)Whitelist_BankAddr(bank);
+    uint32_t size;
+
+    // Flash borrada (0xFF) o imagen a medio escribir (la cabecera se
+    // escribe la última)
+    if(h->magic != WHITELIST_MAGIC || !body_size(h, &size)) {
+        return 0;
+    }
+    return Whitelist_CRC(h + 1, size) == h->crc;
+}
+
+int Whitelist_Activate(uint8_t bank) {
+    if(!bank_valid(bank)) {
+        return -1;
+    }
+    header = (const Whitelist_Header *)Whitelist_BankAddr(bank);
+    body = (const uint8_t *)(header + 1);
+    active = bank;
+    valid = 1;
+    return 0;
+}
+
+int Whitelist_Init(void) {
+    const Whitelist_Header *a = (const Whitelist_Header *)WHITELIST_ADDR;
+    const Whitelist_Header *b = (const Whitelist_Header *)WHITELIST_ADDR_B;
+    uint8_t va = bank_valid(0);
+    uint8_t vb = bank_valid(1);
+
+    valid = 0;
+    if(va && (!vb || a->version >= b->version)) {
+        return Whitelist_Activate(0);
+    }
+    if(vb) {
+        return Whitelist_Activate(1);
+    }
+    return -1;
+}
+
+uint8_t Whitelist_ActiveBank(void) {
+    return active;
+}
+
+void Whitelist_Get(uint32_t index, Whitelist_Entry *e) {
+    const uint8_t *table = body;
+
+    memset(e, 0, sizeof(*e));
+    for(uint8_t t = 0; t < WHITELIST_TABLES; t++) {
+        uint8_t size = WHITELIST_UID_SIZE(t);
+        if(index < header->count[t]) {
+            e->size = size;
+            memcpy(e->uid, table + index * size, size);
+            return;
+        }
+        index -= header->count[t];
+        table += header->count[t] * size;
+    }
+}
+
+uint32_t Whitelist_Digest(void) {
+    return valid ? header->crc : 0;
+}
+
+uint8_t Whitelist_Valid(void) {
+    return valid;
+}
+
+uint32_t Whitelist_Count(void) {
+    return valid ? header->count[0] + header->count[1] + header->count[2] : 0;
+}
+
+uint32_t Whitelist_Version(void) {
+    return valid ? header->version : 0;
+}
+
+uint8_t Whitelist_Contains(const RC522_Uid *card) {
+    const uint8_t *table = body;
+    uint8_t size = card->size;
+    uint8_t t;
+    uint32_t lo = 0;
+    uint32_t hi;
+
+    if(!valid || (size != 4 && size != 7 && size != 10)) {
+        return 0;
+    }
+    t = WHITELIST_TABLE(size);
+    for(uint8_t i = 0; i < t; i++) {
+        table += header->count[i] * WHITELIST_UID_SIZE(i);
+    }
+
+    // Búsqueda binaria en la tabla de su tamaño: ~15 comparaciones para 32K UIDs
+    hi = header->count[t];
+    while(lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = memcmp(table + mid * size, card->uid, size);
+        if(cmp == 0) {
+            return 1;
+        }
+        if(cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef WHITELIST_H
+#define WHITELIST_H
+
+#include <stdint.h>
+#include "rc522.h"
+
+// ===== Lista blanca de UIDs en flash =====
+// Dos bancos de 128 KB (sectores 6 y 7): cabecera y tres tablas
+// ordenadas (memcmp) para búsqueda binaria, una por tamaño de UID (4, 7
+// y 10 bytes), seguidas y sin relleno entre ellas. El CRC-32 del cuerpo
+// se comprueba al arrancar con la unidad CRC del STM32 y se usa el banco
+// válido de versión más alta; sin ninguno se deniega todo. sync.c escribe
+// el banco inactivo y lo activa al terminar.
+#define WHITELIST_ADDR      0x08040000UL    // Banco A (sector 6)
+#define WHITELIST_ADDR_B    0x08060000UL    // Banco B (sector 7)
+#define WHITELIST_SIZE      0x20000UL
+#define WHITELIST_BANKS     2
+#define WHITELIST_MAGIC     0x32534C57UL    // "WLS2"
+
+// Tablas: 0, 1 y 2 para UIDs de 4, 7 y 10 bytes
+#define WHITELIST_TABLES            3
+#define WHITELIST_TABLE(size)       (((size) - 4) / 3)
+#define WHITELIST_UID_SIZE(table)   (4 + 3 * (table))
+
+// Entrada en RAM (delta de sync.c): tamaño del UID y UID alineado a la
+// izquierda con ceros de relleno. memcmp ordena por tamaño y después por
+// UID, el mismo orden que las tablas de la flash
+typedef struct {
+    uint8_t size;
+    uint8_t uid[10];
+} Whitelist_Entry;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;                   // Versión del conjunto (la asigna el servidor)
+    uint32_t count[WHITELIST_TABLES];   // UIDs de 4, 7 y 10 bytes
+    uint32_t crc;                       // CRC-32 STM32 (poli 0x04C11DB7, palabras) del cuerpo
+} Whitelist_Header;
+
+// Cuerpo: las tres tablas completadas con 0xFF hasta múltiplo de 4 bytes.
+// Caben 32762 UIDs de 4 bytes, 18721 de 7 o 13104 de 10 por banco
+#define WHITELIST_BODY_MAX      (WHITELIST_SIZE - sizeof(Whitelist_Header))
+#define WHITELIST_MAX_ENTRIES   (WHITELIST_BODY_MAX / 4)
+
+// ===== Funciones =====
+// Elige el banco activo; 0 si hay uno válido, -1 si no (se deniega todo)
+extern int Whitelist_Init(void);
+
+extern uint8_t Whitelist_Valid(void);
+extern uint32_t Whitelist_Count(void);
+extern uint32_t Whitelist_Version(void);
+extern uint32_t Whitelist_Digest(void);     // CRC del cuerpo activo
+
+// Bancos: dirección, banco activo (0/1) y cambio a un banco recién escrito
+extern uint32_t Whitelist_BankAddr(uint8_t bank);
+extern uint8_t Whitelist_ActiveBank(void);
+extern int Whitelist_Activate(uint8_t bank);
+
+// Entrada index (0..Whitelist_Count()-1) del banco activo, en el orden
+// de las tablas
+extern void Whitelist_Get(uint32_t index, Whitelist_Entry *e);
+
+// 1 si el UID está en la lista
+extern uint8_t Whitelist_Contains(const RC522_Uid *card);
+
+// CRC-32 con la unidad CRC del STM32 (len múltiplo de 4)
+extern uint32_t Whitelist_CRC(const void *data, uint32_t len);
+
+#endif